@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+"""
+Reads the binary columnar logs written by cwaggle_lasso with 'logFormat binary' (see
+cwaggle/src/lasso/BinaryLog.hpp for the layout).
+
+    columns = read_binlog("../data/log_0.bin")
+    columns["eval"], columns["robot0.x"], ...
+
+Each column comes back as a numpy array.  'stats_frame' gives a pandas DataFrame with the
+same columns as a stats_<trial>.dat file.  Run as a script to print a summary of a file.
+"""
+import struct
+import sys
+
+import numpy as np
+
+TYPES = {1: np.dtype('<i4'), 2: np.dtype('<i8'), 3: np.dtype('<f8')}
+
+STATS_COLUMNS = ['step', 'eval', 'propSlowed', 'cumPropSlowed', 'avgTau', 'avgMedianTau', 'avgFilteredTau', 'avgState']
+
+def read_binlog(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    if data[:8] != b'CWLOG\0\0\0':
+        raise ValueError("{} is not a binary log".format(filename))
+    version, num_columns = struct.unpack_from('<II', data, 8)
+    if version != 1:
+        raise ValueError("{} has unsupported version {}".format(filename, version))
+
+    offset = 16
+    schema = []
+    for _ in range(num_columns):
+        type_code, name_length = struct.unpack_from('<BH', data, offset)
+        offset += 3
+        name = data[offset:offset + name_length].decode()
+        offset += name_length
+        schema.append((name, TYPES[type_code]))
+
+    chunks = {name: [] for name, _ in schema}
+    while offset + 4 <= len(data):
+        (rows,) = struct.unpack_from('<I', data, offset)
+        offset += 4
+        chunk = {}
+        for name, dtype in schema:
+            size = rows * dtype.itemsize
+            if offset + size > len(data):
+                break
+            chunk[name] = np.frombuffer(data, dtype, rows, offset)
+            offset += size
+        if len(chunk) < len(schema):
+            # A chunk cut short by a killed run; keep the complete ones.
+            break
+        for name in chunk:
+            chunks[name].append(chunk[name])
+
+    return {name: concat(chunks[name], dtype) for name, dtype in schema}
+
+def concat(parts, dtype):
+    return np.concatenate(parts) if parts else np.zeros(0, dtype)
+
+def stats_frame(filename):
+    import pandas as pd
+    columns = read_binlog(filename)
+    return pd.DataFrame({name: columns[name] for name in STATS_COLUMNS})
+
+def main():
+    for filename in sys.argv[1:]:
+        columns = read_binlog(filename)
+        rows = len(columns['step']) if 'step' in columns else 0
+        print("{}: {} rows, {} columns".format(filename, rows, len(columns)))
+        for name, values in columns.items():
+            if len(values) > 0:
+                print("  {:20s} {:>8s} first {} last {}".format(name, str(values.dtype), values[0], values[-1]))
+
+if __name__ == "__main__":
+    main()
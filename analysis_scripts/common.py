@@ -98,5 +98,26 @@ def readCSV(filename, xColumn, yColumn, delim=' '):
     finally:
         f.close()
 
+def readColumns(filename):
+    """
+    All the columns of a log file, text or binary, as a dict of numpy arrays.  Text columns
+    are named by position ('0', '1', ...), binary ones by the log's schema.  Uses the
+    memory-mapped reader in cwaggle/bin if it has been built ('make cwaggle_logreader'),
+    which returns read-only views rather than copies, and numpy otherwise.
+    """
+    try:
+        import cwaggle_logreader
+        return cwaggle_logreader.LogFile(filename).to_dict()
+    except ImportError:
+        pass
+
+    with open(filename, 'rb') as f:
+        binary = f.read(8) == b'CWLOG\0\0\0'
+    if binary:
+        import binlog
+        return binlog.read_binlog(filename)
+    data = np.loadtxt(filename, ndmin=2)
+    return {str(i): data[:, i] for i in range(data.shape[1])}
+
 if __name__ == "__main__":
     test()
@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+"""
+A minimal viewer for the live telemetry of cwaggle_lasso (see LiveTelemetry.hpp).  Binds
+the Unix domain socket named by 'liveTelemetrySocket' and prints a line per message:
+
+    python live.py /tmp/cwaggle.sock
+
+Start it before or during a run; messages sent while nothing is listening are dropped.
+'messages' can be used on its own to feed a dashboard.
+"""
+import json
+import os
+import socket
+import sys
+
+def messages(path):
+    """Yield each message sent to the socket at 'path', as a dict."""
+    if os.path.exists(path):
+        os.unlink(path)
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    sock.bind(path)
+    try:
+        while True:
+            yield json.loads(sock.recv(1 << 20))
+    finally:
+        sock.close()
+        os.unlink(path)
+
+def main():
+    if len(sys.argv) != 2:
+        print("usage: live.py SOCKET_PATH")
+        sys.exit(1)
+    try:
+        for m in messages(sys.argv[1]):
+            poses = " (%d robots, %d pucks)" % (len(m["robots"]), len(m["pucks"])) if "robots" in m else ""
+            print("%s trial %d step %d eval %s propSlowed %s%s" % (m["condition"], m["trial"], m["step"], m["eval"], m["propSlowed"], poses))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+if __name__ == "__main__":
+    main()
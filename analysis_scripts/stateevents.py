@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+"""
+Reads the controller state events written by cwaggle_lasso with 'stateEvents 1' (see
+DataLogger::writeStateEvent), one line per event:
+
+    step robot oldState newState laps medianTau filteredTau
+
+with a line per robot at step 0 for the initial state.
+
+    events = read_events("../data/stateEvents_0.dat")
+    states = reconstruct(events, range(0, 20001, 10))
+
+'reconstruct' gives the state of every robot at each of the given steps, as in the
+robotState_<trial>.dat files; 'laps' does the same for the lap counts.  Run as a script to
+print the reconstructed robotState table:
+
+    python stateevents.py ../data/stateEvents_0.dat 10 20000
+"""
+import sys
+
+import numpy as np
+
+COLUMNS = ['step', 'robot', 'oldState', 'newState', 'laps', 'medianTau', 'filteredTau']
+
+STATE_NAMES = ['NORMAL', 'SATISFIED', 'AT_BORDER', 'STOPPED']
+
+def read_events(filename):
+    data = np.loadtxt(filename, ndmin=2)
+    events = {name: data[:, i] for i, name in enumerate(COLUMNS)}
+    for name in ['step', 'robot', 'oldState', 'newState', 'laps']:
+        events[name] = events[name].astype(np.int64)
+    return events
+
+def num_robots(events):
+    return int(events['robot'].max()) + 1 if len(events['robot']) > 0 else 0
+
+def step_values(events, steps, column):
+    """The value of 'column' for each robot after the last event at or before each step."""
+    steps = np.asarray(steps)
+    values = np.zeros((len(steps), num_robots(events)), events[column].dtype)
+    for robot in range(values.shape[1]):
+        mine = events['robot'] == robot
+        event_steps = events['step'][mine]
+        event_values = events[column][mine]
+        # The events are in step order, so the last event at or before each step is found by bisection.
+        index = np.searchsorted(event_steps, steps, side='right') - 1
+        values[:, robot] = np.where(index >= 0, event_values[np.maximum(index, 0)], 0)
+    return values
+
+def reconstruct(events, steps):
+    return step_values(events, steps, 'newState')
+
+def laps(events, steps):
+    return step_values(events, steps, 'laps')
+
+def main():
+    if len(sys.argv) != 4:
+        print("usage: stateevents.py EVENTS_FILE SKIP LAST_STEP")
+        sys.exit(1)
+    events = read_events(sys.argv[1])
+    steps = np.arange(0, int(sys.argv[3]) + 1, int(sys.argv[2]))
+    for step, states in zip(steps, reconstruct(events, steps)):
+        print(" ".join(str(v) for v in [step] + list(states)))
+
+if __name__ == "__main__":
+    main()
@@ -13,6 +13,7 @@ protected:
 public:
 
     EntityController() {}
+
     virtual EntityAction getAction() = 0;
 
     EntityAction getLastAction()
@@ -1,14 +1,106 @@
 #pragma once
 
 #include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 #include "Simulator.hpp"
 #include "Vec2.hpp"
 #include "SensorTools.hpp"
 #include "KeyboardCallback.hpp"
+#include "SpscRing.hpp"
+#include "TripleBuffer.hpp"
+#include "VideoRecorder.hpp"
+#include "Heatmap.hpp"
+#include "SpatialGrid.hpp"
+
+/**
+ * Everything the GUI draws for one frame, taken from the world by GUI::publish() so that
+ * it can be drawn without touching the world.
+ */
+struct RenderSnapshot
+{
+    struct Body
+    {
+        sf::Vector2f p, velocityEnd;
+        float r;
+        sf::Color color;
+        size_t points;
+        bool moving;
+    };
+
+    struct Robot
+    {
+        sf::Vector2f p;
+        float r, angle;
+        bool selected, hasTerritory;
+        sf::Vector2f territoryCentre;
+        float territoryRadius;
+        sf::Color territoryColor;
+    };
+
+    struct Sensor
+    {
+        sf::Vector2f p;
+        float r;
+        bool detected;
+    };
+
+    struct Wall
+    {
+        sf::Vector2f s, e;
+        float r;
+    };
+
+    // A grid as an RGBA image, row by row.  Each row has the version at which its pixels
+    // last changed, so that only changed rows need to be copied or uploaded.
+    struct Grid
+    {
+        bool visible = false;
+        size_t width = 0, height = 0;
+        uint64_t version = 0;               // the latest of the row versions
+        std::vector<uint64_t> rowVersions;
+        std::vector<uint32_t> pixels;
+    };
+
+    size_t width = 0, height = 0;
+    sf::FloatRect view;                     // the part of the world shown
+    std::vector<Body> bodies;
+    std::vector<sf::Vertex> plows;          // triangles
+    std::vector<sf::Vertex> tiles;          // triangles, for clusters of bodies when zoomed out
+    std::vector<Robot> robots;
+    std::vector<Sensor> sensors;
+    std::vector<sf::Vertex> indicators;     // lines
+    std::vector<Wall> walls;
+    std::vector<sf::Vertex> collisions;     // lines
+    std::vector<sf::Vertex> heatmap;        // triangles
+    std::vector<Grid> grids;                // the visible ones are blended together as the background
+    std::string status;
+    bool drawCircles = true, drawLines = true, drawSensors = false, debug = false;
+};
 
+/**
+ * The window onto a simulation.  update() handles the user's input, takes a RenderSnapshot
+ * of the world and draws it.  With a render thread, drawing and window events move to that
+ * thread: update() then only applies the input events the render thread queued and
+ * publishes the snapshot, through a TripleBuffer, so the simulation never waits for the
+ * display and the display always shows the latest snapshot.
+ *
+ * The window shows the world through a view that can be zoomed (mouse wheel, + / -, F to
+ * fit the arena) and panned (dragging with the middle button, or with the left button
+ * away from any body).  Only what is in view goes into a snapshot, found through a
+ * SpatialGrid of the bodies, and when the bodies are drawn only a few pixels across the
+ * detail drops: no plows, velocity lines or sensors, coarser circles, and dense clusters
+ * of bodies other than robots drawn as one tile each.
+ */
 class GUI {
     std::shared_ptr<Simulator> m_sim;
     sf::RenderWindow m_window; // the window we will draw to
@@ -24,60 +116,170 @@ class GUI {
     size_t m_controlsHeight = 0;
     size_t m_windowWidth;
     size_t m_windowHeight;
+    size_t m_fps;
+
+    // The view: the arena area of the window is m_arenaWidth * m_arenaHeight pixels, each
+    // m_unitsPerPixel world units, centred on m_viewCentre.
+    size_t m_arenaWidth, m_arenaHeight;
+    sf::Vector2f m_viewCentre;
+    float m_unitsPerPixel = 1, m_fitUnitsPerPixel = 1;
+    bool m_panning = false;
+    sf::Vector2i m_panFrom;
+
+    // The entities of the last snapshot, indexed by position for culling and picking, and
+    // the furthest any of them is drawn from its position.
+    SpatialGrid m_index;
+    std::vector<Entity> m_indexed;
+    float m_maxExtent = 0;
+
+    // The level of detail drops when m_maxExtent is drawn smaller than m_coarsePixels.
+    // Then each m_tilePixels square holding m_tileBodies or more bodies other than robots
+    // is drawn as a tile.
+    float m_coarsePixels = 12;
+    float m_tilePixels = 16;
+    size_t m_tileBodies = 3;
 
 private:
     std::string m_status = "";
     bool m_leftMouseDown = false;
 
-    // AV: For drawing a background image.
-    sf::Texture m_backgroundTexture;
-    sf::Sprite m_backgroundSprite;
+    // The images of the world's grids, which can be drawn as the background, and the
+    // colour tables for converting grid values to them (see convertGrid).
+    std::vector<RenderSnapshot::Grid> m_gridImages;
+    uint64_t m_gridVersion = 0;
+    std::vector<uint32_t> m_colorTables[8];
+    std::vector<uint32_t> m_rowPixels;
 
-    // A vector of pairs of (image, bool) where the bool indicates whether the
-    // image should be drawn. 
-    std::vector<std::pair<sf::Image, bool>> m_backgroundImages;
+    // A texture per grid, with the versions of the rows it holds.
+    struct GridTexture
+    {
+        sf::Texture texture;
+        std::vector<uint64_t> rowVersions;
+    };
+    std::vector<GridTexture> m_gridTextures;
+    sf::Sprite m_gridSprite;
 
-    // AV: For showing the occupancy of robots
-    sf::Image m_occupancyImage;
+    // A heatmap of where the robots have been lately, shown with the O key (see setHeatmap).
+    const Heatmap * m_heatmap = nullptr;
+    bool m_showHeatmap = false;
 
     KeyboardCallback* m_keyboardCallback = nullptr;
 
+    // The vertex arrays render() fills each frame (see there), and the circle corners they use.
+    sf::VertexArray m_bodyTriangles{ sf::Triangles }, m_bodyLines{ sf::Lines };
+    sf::VertexArray m_overlayTriangles{ sf::Triangles }, m_overlayLines{ sf::Lines };
+    std::map<size_t, std::vector<sf::Vector2f>> m_unitCircles;
+
+    // Snapshots from the simulation to the drawing, and window events the other way.
+    TripleBuffer<RenderSnapshot> m_snapshots;
+    SpscRing<sf::Event> m_events{ 256 };
+    bool m_threaded;
+    std::thread m_renderThread;
+    std::atomic<bool> m_stopRendering{ false };
+
+    // Video recording, done from the thread that draws (see captureFrame).
+    std::string m_videoFilename;
+    size_t m_videoFrameRate;
+    std::unique_ptr<VideoRecorder> m_video;
+
     void init(std::shared_ptr<Simulator> sim)
     {
         m_sim = sim;
-        m_font.loadFromFile("fonts/cour.ttf");
-        m_text.setFont(m_font);
-        m_text.setCharacterSize(24);
-        m_text.setPosition(5, 5);
-        //m_text.setFillColor(sf::Color::Yellow);
 
         int width = m_sim->getWorld()->width();
         int height = m_sim->getWorld()->height();
 
         // Create all images which can be used as the background.
+        m_gridImages.assign(m_sim->getWorld()->getNumberOfGrids(), RenderSnapshot::Grid());
         for (int i = 0; i < m_sim->getWorld()->getNumberOfGrids(); i++) {
             auto& grid = m_sim->getWorld()->getGrid(i);
             assert(grid.width() == width);
             assert(grid.height() == height);
+            convertGrid(grid, 0, 1, colorTable(true, true, true), m_gridImages[i]);
+        }
 
-            sf::Image gridImage;
-            gridImage.create(width, height);
-
-            for (size_t x = 0; x < grid.width(); x++) {
-                for (size_t y = 0; y < grid.height(); y++) {
-                    uint8_t c = (uint8_t)(grid.get(x, y) * 255);
-                    sf::Color color(c, c, c);
-                    gridImage.setPixel(x, y, color);
+        m_maxExtent = 0;
+        m_indexed.clear();
+        m_index.reset(width, height, std::max(width, height));
+        for (auto e : m_sim->getWorld()->getEntities()) {
+            if (e.hasComponent<CCircleBody>())
+                m_maxExtent = std::max(m_maxExtent, (float)e.getComponent<CCircleBody>().r);
+            if (e.hasComponent<CCircleShape>())
+                m_maxExtent = std::max(m_maxExtent, e.getComponent<CCircleShape>().shape.getRadius());
+            if (e.hasComponent<CPlowBody>()) {
+                auto & shape = e.getComponent<CPlowBody>().shape;
+                for (size_t i = 0; i < shape.getPointCount(); i++) {
+                    sf::Vector2f p = shape.getPoint(i);
+                    m_maxExtent = std::max(m_maxExtent, (float)sqrt(p.x * p.x + p.y * p.y));
                 }
             }
-
-            m_backgroundImages.push_back(std::make_pair(gridImage, false));
         }
+    }
+
+    // Show the whole arena.
+    void fitView()
+    {
+        double width = m_sim->getWorld()->width(), height = m_sim->getWorld()->height();
+        m_fitUnitsPerPixel = (float)std::max(width / m_arenaWidth, height / m_arenaHeight);
+        m_unitsPerPixel = m_fitUnitsPerPixel;
+        m_viewCentre = sf::Vector2f((float)width / 2, (float)height / 2);
+    }
+
+    // The point of the world at a pixel of the window.
+    sf::Vector2f toWorld(int x, int y) const
+    {
+        return sf::Vector2f(m_viewCentre.x + (x - m_arenaWidth / 2.0f) * m_unitsPerPixel, m_viewCentre.y + (y - m_arenaHeight / 2.0f) * m_unitsPerPixel);
+    }
 
-        m_occupancyImage.create(width, height);
+    // Zoom by a factor (below 1 to zoom in), keeping the point at the given pixel in place.
+    void zoomAt(int x, int y, float factor)
+    {
+        sf::Vector2f p = toWorld(x, y);
+        m_unitsPerPixel = std::min(std::max(m_unitsPerPixel * factor, m_fitUnitsPerPixel / 64), m_fitUnitsPerPixel);
+        m_viewCentre = sf::Vector2f(p.x - (x - m_arenaWidth / 2.0f) * m_unitsPerPixel, p.y - (y - m_arenaHeight / 2.0f) * m_unitsPerPixel);
+        clampView();
+    }
+
+    // Keep the centre of the view over the arena.
+    void clampView()
+    {
+        float width = (float)m_sim->getWorld()->width(), height = (float)m_sim->getWorld()->height();
+        m_viewCentre.x = std::min(std::max(m_viewCentre.x, 0.0f), width);
+        m_viewCentre.y = std::min(std::max(m_viewCentre.y, 0.0f), height);
+    }
 
-        m_backgroundTexture.loadFromImage(m_occupancyImage);
-        m_backgroundSprite.setTexture(m_backgroundTexture);
+    // The first entity whose body contains a point, looked up in the last snapshot's index.
+    Entity entityAt(sf::Vector2f p, bool withControllerVis)
+    {
+        Entity found;
+        Vec2 point(p.x, p.y);
+        m_index.query(p.x - m_maxExtent, p.y - m_maxExtent, p.x + m_maxExtent, p.y + m_maxExtent, [&](const SpatialGrid::Item & item) {
+            Entity e = m_indexed[item.index];
+            if (found != Entity() || !e.hasComponent<CCircleBody>() || (withControllerVis && !e.hasComponent<CControllerVis>()))
+                return;
+            if (point.dist(e.getComponent<CTransform>().p) < e.getComponent<CCircleBody>().r)
+                found = e;
+        });
+        return found;
+    }
+
+    // Create the window.  This is done by the thread that draws, which also gets its events.
+    void createWindow()
+    {
+        m_window.create(sf::VideoMode(m_windowWidth, m_windowHeight), "CWaggle", sf::Style::Titlebar | sf::Style::Close);
+        m_window.setFramerateLimit(m_fps);
+
+        // Scale the window size up for high-res screens.
+        double scaleFactor = 1;
+        size_t scaledWindowWidth = scaleFactor * m_windowWidth;
+        size_t scaledWindowHeight = scaleFactor * m_windowHeight;
+        m_window.setSize(sf::Vector2u(scaledWindowWidth, scaledWindowHeight));
+
+        m_font.loadFromFile("fonts/cour.ttf");
+        m_text.setFont(m_font);
+        m_text.setCharacterSize(24);
+        m_text.setPosition(5, 5);
+        //m_text.setFillColor(sf::Color::Yellow);
     }
 
     void rotateRobots(double angle)
@@ -90,124 +292,166 @@ private:
         }
     }
 
-    void sUserInput()
+    // Quit at the user's request, stopping the render thread and finishing the video first.
+    void quit()
     {
-        sf::Event event;
-        while (m_window.pollEvent(event)) {
-            // this event triggers when the window is closed
-            if (event.type == sf::Event::Closed) {
-                exit(0);
-            }
+        stopRenderThread();
+        m_video.reset();
+        exit(0);
+    }
 
-            // this event is triggered when a key is pressed
-            if (event.type == sf::Event::KeyPressed) {
-
-                if (m_keyboardCallback != nullptr)
-                    m_keyboardCallback->keyHandler(event.key.code);
-
-                switch (event.key.code) {
-                case sf::Keyboard::Escape:
-                    exit(0);
-                    break;
-                case sf::Keyboard::C:
-                    m_drawCircles = !m_drawCircles;
-                    break;
-                case sf::Keyboard::D:
-                    m_debug = !m_debug;
-                    break;
-                case sf::Keyboard::S:
-                    m_sensors = !m_sensors;
-                    break;
-                case sf::Keyboard::L:
-                    m_drawLines = !m_drawLines;
-                    break;
-                case sf::Keyboard::O:
-                    //m_backgroundImagePtr = &m_occupancyImage;
-                    break;
-                case sf::Keyboard::Num0:
-                    m_backgroundImages[0].second = !m_backgroundImages[0].second;
-                    break;
-                case sf::Keyboard::Num1:
-                    m_backgroundImages[1].second = !m_backgroundImages[1].second;
-                    break;
-                case sf::Keyboard::Num2:
-                    m_backgroundImages[2].second = !m_backgroundImages[2].second;
-                    break;
-                case sf::Keyboard::Num3:
-                    m_backgroundImages[3].second = !m_backgroundImages[3].second;
-                    break;
-                case sf::Keyboard::Num4:
-                    m_backgroundImages[4].second = !m_backgroundImages[4].second;
-                    break;
-                case sf::Keyboard::Num5:
-                    m_backgroundImages[5].second = !m_backgroundImages[5].second;
-                    break;
-                //case sf::Keyboard::Num6:
-                //    m_backgroundImages[6].second = !m_backgroundImages[6].second;
-                //    break;
-                case sf::Keyboard::Left:
-                    rotateRobots(-0.15);
-                    break;
-                case sf::Keyboard::Right:
-                    rotateRobots(0.15);
-                    break;
-                case sf::Keyboard::A:
-                    // Select all robots
-                    for (auto e : m_sim->getWorld()->getEntities()) {
-                        if (!e.hasComponent<CControllerVis>()) { continue; }
-                        e.getComponent<CControllerVis>().selected = true;
-                    }
-                    break;
+    // Act on a window event.  This runs on the simulation's thread, as it changes the world.
+    void handleEvent(const sf::Event & event)
+    {
+        // this event triggers when the window is closed
+        if (event.type == sf::Event::Closed) {
+            quit();
+        }
 
-                case sf::Keyboard::N:
-                    // De-select all robots
-                    for (auto e : m_sim->getWorld()->getEntities()) {
-                        if (!e.hasComponent<CControllerVis>()) { continue; }
-                        e.getComponent<CControllerVis>().selected = false;
-                    }
-                    break;
+        // this event is triggered when a key is pressed
+        if (event.type == sf::Event::KeyPressed) {
+
+            if (m_keyboardCallback != nullptr)
+                m_keyboardCallback->keyHandler(event.key.code);
+
+            switch (event.key.code) {
+            case sf::Keyboard::Escape:
+                quit();
+                break;
+            case sf::Keyboard::C:
+                m_drawCircles = !m_drawCircles;
+                break;
+            case sf::Keyboard::D:
+                m_debug = !m_debug;
+                break;
+            case sf::Keyboard::S:
+                m_sensors = !m_sensors;
+                break;
+            case sf::Keyboard::L:
+                m_drawLines = !m_drawLines;
+                break;
+            case sf::Keyboard::O:
+                m_showHeatmap = !m_showHeatmap;
+                break;
+            case sf::Keyboard::Equal:
+            case sf::Keyboard::Add:
+                zoomAt(m_arenaWidth / 2, m_arenaHeight / 2, 0.8f);
+                break;
+            case sf::Keyboard::Hyphen:
+            case sf::Keyboard::Subtract:
+                zoomAt(m_arenaWidth / 2, m_arenaHeight / 2, 1.25f);
+                break;
+            case sf::Keyboard::F:
+                fitView();
+                break;
+            case sf::Keyboard::Num0:
+                m_gridImages[0].visible = !m_gridImages[0].visible;
+                break;
+            case sf::Keyboard::Num1:
+                m_gridImages[1].visible = !m_gridImages[1].visible;
+                break;
+            case sf::Keyboard::Num2:
+                m_gridImages[2].visible = !m_gridImages[2].visible;
+                break;
+            case sf::Keyboard::Num3:
+                m_gridImages[3].visible = !m_gridImages[3].visible;
+                break;
+            case sf::Keyboard::Num4:
+                m_gridImages[4].visible = !m_gridImages[4].visible;
+                break;
+            case sf::Keyboard::Num5:
+                m_gridImages[5].visible = !m_gridImages[5].visible;
+                break;
+            //case sf::Keyboard::Num6:
+            //    m_gridImages[6].visible = !m_gridImages[6].visible;
+            //    break;
+            case sf::Keyboard::Left:
+                rotateRobots(-0.15);
+                break;
+            case sf::Keyboard::Right:
+                rotateRobots(0.15);
+                break;
+            case sf::Keyboard::A:
+                // Select all robots
+                for (auto e : m_sim->getWorld()->getEntities()) {
+                    if (!e.hasComponent<CControllerVis>()) { continue; }
+                    e.getComponent<CControllerVis>().selected = true;
+                }
+                break;
 
-                default:
-                    break;
+            case sf::Keyboard::N:
+                // De-select all robots
+                for (auto e : m_sim->getWorld()->getEntities()) {
+                    if (!e.hasComponent<CControllerVis>()) { continue; }
+                    e.getComponent<CControllerVis>().selected = false;
                 }
+                break;
+
+            default:
+                break;
             }
+        }
 
-            if (event.type == sf::Event::MouseButtonPressed) {
-                if (event.mouseButton.button == sf::Mouse::Left) {
-                    for (auto e : m_sim->getWorld()->getEntities()) {
-                        Vec2 mPos((double)event.mouseButton.x, (double)event.mouseButton.y);
-                        if (mPos.dist(e.getComponent<CTransform>().p) < e.getComponent<CCircleBody>().r) {
-                            m_draggedEntity = e;
-                            break;
-                        }
-                    }
-                }
+        if (event.type == sf::Event::MouseButtonPressed) {
+            sf::Vector2f p = toWorld(event.mouseButton.x, event.mouseButton.y);
 
-                // Right-click modifies an entity's ControllerVis object (if it has one)
-                if (event.mouseButton.button == sf::Mouse::Right) {
-                    for (auto e : m_sim->getWorld()->getEntities()) {
-                        if (!e.hasComponent<CControllerVis>()) { continue; }
-
-                        Vec2 mPos((double)event.mouseButton.x, (double)event.mouseButton.y);
-                        if (mPos.dist(e.getComponent<CTransform>().p) < e.getComponent<CCircleBody>().r) {
-                            // Toggle the selected status.
-                            e.getComponent<CControllerVis>().selected = 
-                                !(e.getComponent<CControllerVis>().selected);
-                            break;
-                        }
-                    }
-                }
+            // Left-drag moves the entity under the mouse, or else the view, as the middle button does.
+            if (event.mouseButton.button == sf::Mouse::Left) {
+                m_draggedEntity = entityAt(p, false);
+                m_mousePos = p;
+            }
+            if ((event.mouseButton.button == sf::Mouse::Left && m_draggedEntity == Entity()) || event.mouseButton.button == sf::Mouse::Middle) {
+                m_panning = true;
+                m_panFrom = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
             }
 
-            if (event.type == sf::Event::MouseButtonReleased) {
-                if (event.mouseButton.button == sf::Mouse::Left) {
-                    m_draggedEntity = Entity();
+            // Right-click modifies an entity's ControllerVis object (if it has one)
+            if (event.mouseButton.button == sf::Mouse::Right) {
+                Entity e = entityAt(p, true);
+                if (e != Entity()) {
+                    // Toggle the selected status.
+                    e.getComponent<CControllerVis>().selected =
+                        !(e.getComponent<CControllerVis>().selected);
                 }
             }
+        }
+
+        if (event.type == sf::Event::MouseButtonReleased) {
+            if (event.mouseButton.button == sf::Mouse::Left) {
+                m_draggedEntity = Entity();
+            }
+            if (event.mouseButton.button == sf::Mouse::Left || event.mouseButton.button == sf::Mouse::Middle) {
+                m_panning = false;
+            }
+        }
 
-            if (event.type == sf::Event::MouseMoved) {
-                m_mousePos = sf::Vector2f((float)event.mouseMove.x, (float)event.mouseMove.y);
+        if (event.type == sf::Event::MouseMoved) {
+            if (m_panning) {
+                m_viewCentre.x -= (event.mouseMove.x - m_panFrom.x) * m_unitsPerPixel;
+                m_viewCentre.y -= (event.mouseMove.y - m_panFrom.y) * m_unitsPerPixel;
+                m_panFrom = sf::Vector2i(event.mouseMove.x, event.mouseMove.y);
+                clampView();
             }
+            m_mousePos = toWorld(event.mouseMove.x, event.mouseMove.y);
+        }
+
+        if (event.type == sf::Event::MouseWheelScrolled && event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel) {
+            zoomAt(event.mouseWheelScroll.x, event.mouseWheelScroll.y, (float)pow(0.8, event.mouseWheelScroll.delta));
+        }
+    }
+
+    void sUserInput()
+    {
+        if (m_threaded) {
+            while (sf::Event * event = m_events.front()) {
+                sf::Event e = *event;
+                m_events.pop();
+                handleEvent(e);
+            }
+        } else {
+            sf::Event event;
+            while (m_window.pollEvent(event))
+                handleEvent(event);
         }
 
         if (m_draggedEntity != Entity()) {
@@ -222,195 +466,218 @@ private:
         }
     }
 
-    void drawLine(Vec2 p1, Vec2 p2, sf::Color color)
+    static sf::Vector2f toVector(const Vec2 & v)
     {
-        sf::Vertex line[] = {
-            sf::Vertex(sf::Vector2f((float)p1.x, (float)p1.y), color),
-            sf::Vertex(sf::Vector2f((float)p2.x, (float)p2.y), color)
-        };
-
-        m_window.draw(line, 2, sf::Lines);
+        return sf::Vector2f((float)v.x, (float)v.y);
     }
 
-    void sRender()
+    // Index the entities by position, in cells of about the given size.
+    void indexEntities(const std::shared_ptr<World> & world, double cellSize)
     {
-        m_window.clear();
-
-        // Fill the occupancy grid
-        sf::Color color(255, 255, 255);
-        for (auto robot : m_sim->getWorld()->getEntities("robot")) {
-            auto& t = robot.getComponent<CTransform>();
-            m_occupancyImage.setPixel((int)t.p.x, (int)t.p.y, color);
+        // Not so small a cell that the grid outgrows the entities.
+        double width = world->width(), height = world->height();
+        cellSize = std::max(cellSize, std::max(width, height) / 1024);
+        m_indexed = world->getEntities();
+        m_index.reset(width, height, cellSize);
+        for (size_t i = 0; i < m_indexed.size(); i++) {
+            const Vec2 & p = m_indexed[i].getComponent<CTransform>().p;
+            m_index.insert(i, p.x, p.y);
         }
+        m_index.build();
+    }
 
-        // draw robot plows
-        for (auto e : m_sim->getWorld()->getEntities()) {
-            if (!e.hasComponent<CPlowBody>()) {
-                continue;
+    // A robot's plow, whose points are relative to the robot's centre and rotate with its heading.
+    void appendPlow(RenderSnapshot & s, Entity e)
+    {
+        auto& t = e.getComponent<CTransform>();
+        auto& pb = e.getComponent<CPlowBody>();
+        auto& c = e.getComponent<CColor>();
+        auto& steer = e.getComponent<CSteer>();
+
+        double angle = steer.angle + pb.angle;
+        float cosA = (float)cos(angle), sinA = (float)sin(angle);
+        sf::Color fill(c.r, c.g, c.b, c.a);
+        size_t n = pb.shape.getPointCount();
+        for (size_t i = 1; i + 1 < n; i++) {
+            for (size_t k : { (size_t)0, i, i + 1 }) {
+                sf::Vector2f p = pb.shape.getPoint(k);
+                s.plows.push_back(sf::Vertex(sf::Vector2f((float)t.p.x + p.x * cosA - p.y * sinA, (float)t.p.y + p.x * sinA + p.y * cosA), fill));
             }
+        }
+    }
 
-            auto& t = e.getComponent<CTransform>();
-            auto& pb = e.getComponent<CPlowBody>();
-            auto& c = e.getComponent<CColor>();
+    void appendBody(RenderSnapshot & s, Entity e, bool coarse)
+    {
+        auto& t = e.getComponent<CTransform>();
+        auto& shape = e.getComponent<CCircleShape>().shape;
+        auto& c = e.getComponent<CColor>();
+
+        RenderSnapshot::Body body;
+        body.p = toVector(t.p);
+        body.r = shape.getRadius();
+        body.points = coarse ? std::min(shape.getPointCount(), (size_t)12) : shape.getPointCount();
+        body.color = sf::Color(c.r, c.g, c.b, c.a);
+        if (e.hasComponent<CSteer>()) {
             auto& steer = e.getComponent<CSteer>();
-
-            pb.shape.setPosition((float)t.p.x, (float)t.p.y);
-            pb.shape.setRotation((steer.angle + pb.angle) * 180.0 / M_PI);
-            pb.shape.setFillColor(sf::Color(c.r, c.g, c.b, c.a));
-            m_window.draw(pb.shape);
-
-            // Draw a line along the prow.
-            /*
-            Vec2 prow(t.p.x + pb.length * cos(steer.angle + pb.angle),
-                      t.p.y + pb.length * sin(steer.angle + pb.angle));
-            drawLine(t.p, prow, sf::Color(255, 255, 255));
-            */
+            if (steer.frozen)
+                body.color = sf::Color(50, 50, 50);
+            else if (steer.slowedCount > 0) {
+                body.color = sf::Color(255, 0, 255);
+            }
         }
 
-        // draw circles
-        if (m_drawCircles) {
-            for (auto e : m_sim->getWorld()->getEntities()) {
-                if (!e.hasComponent<CCircleShape>()) {
-                    continue;
-                }
-
-                auto& t = e.getComponent<CTransform>();
-                auto& s = e.getComponent<CCircleShape>();
-                auto& c = e.getComponent<CColor>();
-
-                s.shape.setPosition((float)t.p.x, (float)t.p.y);
-                s.shape.setFillColor(sf::Color(c.r, c.g, c.b, c.a));
+        // A line corresponding to this circle's velocity.
+        body.moving = !coarse && t.v.length() != 0;
+        if (body.moving)
+            body.velocityEnd = toVector(t.p + t.v.normalize() * body.r);
+        s.bodies.push_back(body);
+    }
 
-                if (e.hasComponent<CSteer>()) {
-                    auto& steer = e.getComponent<CSteer>();
-                    if (steer.frozen)
-                        s.shape.setFillColor(sf::Color(50, 50, 50));
-                    else if (steer.slowedCount > 0) {
-                        s.shape.setFillColor(sf::Color(255, 0, 255));
-                    } else {
-                        // A normal robot
-                        //s.shape.setOutlineColor(sf::Color(255, 0, 0, 255));
-                        //s.shape.setOutlineThickness(1);
-                    }
-                }
+    // A tile for a cell of the index, in the mean colour of its bodies, more opaque the more there are.
+    void appendTile(RenderSnapshot & s, size_t col, size_t row, size_t count, unsigned r, unsigned g, unsigned b)
+    {
+        float size = (float)m_index.cellSize();
+        sf::Color color((sf::Uint8)(r / count), (sf::Uint8)(g / count), (sf::Uint8)(b / count), (sf::Uint8)std::min(96 + 32 * count, (size_t)255));
+        sf::Vector2f p0(col * size, row * size), p1((col + 1) * size, row * size), p2((col + 1) * size, (row + 1) * size), p3(col * size, (row + 1) * size);
+        for (auto & corner : { p0, p1, p2, p0, p2, p3 })
+            s.tiles.push_back(sf::Vertex(corner, color));
+    }
 
-                m_window.draw(s.shape);
+    static bool inside(const sf::FloatRect & r, sf::Vector2f p, float margin)
+    {
+        return p.x >= r.left - margin && p.x <= r.left + r.width + margin && p.y >= r.top - margin && p.y <= r.top + r.height + margin;
+    }
 
-                // Draw a line corresponding to this circle's velocity.
-                Vec2 velPoint;
-                double vLength = t.v.length();
-                if (vLength == 0) {
-                    velPoint = Vec2(t.p.x + s.shape.getRadius(), t.p.y);
-                    continue;
-                } else {
-                    velPoint = t.p + t.v.normalize() * s.shape.getRadius();
+    // Take what is to be drawn from the world into the back snapshot and publish it.
+    void publish()
+    {
+        RenderSnapshot & s = m_snapshots.back();
+        auto world = m_sim->getWorld();
+        s.width = world->width();
+        s.height = world->height();
+        s.bodies.clear();
+        s.plows.clear();
+        s.tiles.clear();
+        s.robots.clear();
+        s.sensors.clear();
+        s.indicators.clear();
+        s.walls.clear();
+        s.collisions.clear();
+        s.status = m_status;
+        s.drawCircles = m_drawCircles;
+        s.drawLines = m_drawLines;
+        s.drawSensors = m_sensors;
+        s.debug = m_debug;
+
+        float viewWidth = m_arenaWidth * m_unitsPerPixel, viewHeight = m_arenaHeight * m_unitsPerPixel;
+        s.view = sf::FloatRect(m_viewCentre.x - viewWidth / 2, m_viewCentre.y - viewHeight / 2, viewWidth, viewHeight);
+        const sf::FloatRect & view = s.view;
+        bool coarse = m_maxExtent < m_coarsePixels * m_unitsPerPixel;
+
+        // The heatmap's decayed map, a cell per quad, more opaque the more it was occupied.
+        s.heatmap.clear();
+        if (m_showHeatmap && m_heatmap) {
+            double max = 0;
+            for (size_t row = 0; row < m_heatmap->rows(); row++)
+                for (size_t col = 0; col < m_heatmap->cols(); col++)
+                    max = std::max(max, m_heatmap->decayed(col, row));
+            float size = (float)m_heatmap->cellSize();
+            size_t col0 = (size_t)std::max(view.left / size, 0.0f), row0 = (size_t)std::max(view.top / size, 0.0f);
+            size_t col1 = std::min((size_t)std::max((view.left + view.width) / size + 1, 0.0f), m_heatmap->cols());
+            size_t row1 = std::min((size_t)std::max((view.top + view.height) / size + 1, 0.0f), m_heatmap->rows());
+            for (size_t row = row0; max > 0 && row < row1; row++) {
+                for (size_t col = col0; col < col1; col++) {
+                    double value = m_heatmap->decayed(col, row);
+                    if (value <= 0)
+                        continue;
+                    sf::Color color(255, 96, 0, (sf::Uint8)(40 + 180 * value / max));
+                    sf::Vector2f a(col * size, row * size), b((col + 1) * size, row * size), c((col + 1) * size, (row + 1) * size), d(col * size, (row + 1) * size);
+                    for (auto & corner : { a, b, c, a, c, d })
+                        s.heatmap.push_back(sf::Vertex(corner, color));
                 }
-
-                drawLine(t.p, velPoint, sf::Color(255, 255, 255));
             }
         }
 
-        // Draw all active background images, which are blended together
-        for (std::pair<sf::Image, bool> p : m_backgroundImages) {
-            if (p.second) {
-                m_backgroundTexture.update(p.first);
-                m_window.draw(m_backgroundSprite, sf::RenderStates(sf::BlendAdd));
+        // The bodies in view, cell by cell of the index.  Zoomed out, the cells are the tiles,
+        // and a cell with enough bodies other than robots is drawn as a tile instead of them.
+        indexEntities(world, coarse ? m_tilePixels * m_unitsPerPixel : 4 * m_maxExtent);
+        size_t c0, r0, c1, r1;
+        m_index.cellRange(view.left - m_maxExtent, view.top - m_maxExtent, view.left + view.width + m_maxExtent, view.top + view.height + m_maxExtent, c0, r0, c1, r1);
+        for (size_t row = r0; row <= r1; row++) {
+            for (size_t col = c0; col <= c1; col++) {
+                const SpatialGrid::Item * first = m_index.begin(col, row), * last = m_index.end(col, row);
+                bool tiled = false;
+                if (coarse && m_drawCircles && (size_t)(last - first) >= m_tileBodies) {
+                    size_t count = 0;
+                    unsigned r = 0, g = 0, b = 0;
+                    for (const SpatialGrid::Item * item = first; item != last; item++) {
+                        Entity e = m_indexed[item->index];
+                        if (e.hasComponent<CCircleShape>() && !e.hasComponent<CSteer>()) {
+                            auto& c = e.getComponent<CColor>();
+                            count++;
+                            r += c.r;
+                            g += c.g;
+                            b += c.b;
+                        }
+                    }
+                    tiled = count >= m_tileBodies;
+                    if (tiled)
+                        appendTile(s, col, row, count, r, g, b);
+                }
+
+                for (const SpatialGrid::Item * item = first; item != last; item++) {
+                    if (!inside(view, sf::Vector2f(item->x, item->y), m_maxExtent))
+                        continue;
+                    Entity e = m_indexed[item->index];
+                    if (!coarse && e.hasComponent<CPlowBody>())
+                        appendPlow(s, e);
+                    if (m_drawCircles && e.hasComponent<CCircleShape>() && !(tiled && !e.hasComponent<CSteer>()))
+                        appendBody(s, e, coarse);
+                }
             }
         }
 
-        // draw robot sensors
-        if (m_sensors)
-        {
-            float gridSensorRadius = 2;
-
-            for (auto robot : m_sim->getWorld()->getEntities("robot"))
-            {
-                // if (!m_draggedEntity || robot.id() != m_draggedEntity.id()) { continue; }
-
+        // robot sensors
+        if (m_sensors && !coarse) {
+            for (auto robot : world->getEntities("robot")) {
                 if (!robot.hasComponent<CSensorArray>()) { continue; }
-                auto & sensors = robot.getComponent<CSensorArray>();
-                auto & c = robot.getComponent<CColor>();
-
-                // Position and angle of robot.
-                const Vec2 & pos = robot.getComponent<CTransform>().p;
-                double theta = robot.getComponent<CSteer>().angle;
-
-                sf::Color detectColor(0, 0, 255, 100);
-                sf::Color noDetectColor(0, 0, 127, 100);
-                /*
-                for (auto & sensor : sensors.gridSensors)
-                {
-                    sf::CircleShape sensorShape(gridSensorRadius, 32);
-                    sensorShape.setOrigin(gridSensorRadius, gridSensorRadius);
-                    Vec2 pos = sensor->getPosition();
-                    sensorShape.setPosition((float)pos.x, (float)pos.y);
-                    sensorShape.setFillColor(sf::Color::White);
-                    m_window.draw(sensorShape);
-                }
-                */
-                for (auto & sensor : sensors.robotSensors)
-                {
-                    sf::CircleShape sensorShape(sensor->radius(), 32);
-                    sensorShape.setOrigin(sensor->radius(), sensor->radius());
-                    Vec2 pos = sensor->getPosition();
-                    sensorShape.setPosition((float)pos.x, (float)pos.y);
-                    double reading = sensor->getReading(m_sim->getWorld());
-                    sensorShape.setOutlineColor(sf::Color::White);
-                    if (reading > 0) {
-                        sensorShape.setFillColor(detectColor);
-                        sensorShape.setOutlineThickness(1);
-                    } else {
-                        sensorShape.setFillColor(noDetectColor);
-                        sensorShape.setOutlineThickness(0);
-                    }
-                    m_window.draw(sensorShape);
+                for (auto & sensor : robot.getComponent<CSensorArray>().robotSensors) {
+                    sf::Vector2f p = toVector(sensor->getPosition());
+                    if (inside(view, p, (float)sensor->radius()))
+                        s.sensors.push_back({ p, (float)sensor->radius(), sensor->getReading(world) > 0 });
                 }
             }
         }
 
-        // Draw other robot-specific "decorations".
-        for (auto robot : m_sim->getWorld()->getEntities("robot")) {
-            auto& t = robot.getComponent<CTransform>();
-            auto& s = robot.getComponent<CCircleShape>();
-            auto& c = robot.getComponent<CColor>();
-            auto& steer = robot.getComponent<CSteer>();
-
-            // Draw a line corresponding to this robot's heading.
-            double r = s.shape.getRadius();
-            Vec2 start(t.p.x, t.p.y);
-            Vec2 end(t.p.x + r * cos(steer.angle), t.p.y + r * sin(steer.angle));
-            drawLine(start, end, sf::Color(0, 0, 0));
-
-            // If the robot is selected, draw an outline around it.
-            if (robot.hasComponent<CControllerVis>() && robot.getComponent<CControllerVis>().selected) {
-                r *= 2;
-                sf::Vertex vertices[] = {
-                    sf::Vertex(sf::Vector2f(t.p.x - r/2, t.p.y - r/2), sf::Color::White),
-                    sf::Vertex(sf::Vector2f(t.p.x + r/2, t.p.y - r/2), sf::Color::White),
-                    sf::Vertex(sf::Vector2f(t.p.x + r/2, t.p.y + r/2), sf::Color::White),
-                    sf::Vertex(sf::Vector2f(t.p.x - r/2, t.p.y + r/2), sf::Color::White),
-                    sf::Vertex(sf::Vector2f(t.p.x - r/2, t.p.y - r/2), sf::Color::White)
-                };
-                m_window.draw(vertices, 5, sf::LineStrip);
-            }
-
-            if (robot.hasComponent<CTerritory>()) {
+        // Other robot-specific "decorations".
+        for (auto robot : world->getEntities("robot")) {
+            bool visible = inside(view, toVector(robot.getComponent<CTransform>().p), m_maxExtent);
+            if (!visible && !robot.hasComponent<CTerritory>())
+                continue;
+            RenderSnapshot::Robot r;
+            r.p = toVector(robot.getComponent<CTransform>().p);
+            r.r = robot.getComponent<CCircleShape>().shape.getRadius();
+            r.angle = robot.getComponent<CSteer>().angle;
+            r.selected = robot.hasComponent<CControllerVis>() && robot.getComponent<CControllerVis>().selected;
+            r.hasTerritory = robot.hasComponent<CTerritory>();
+            if (r.hasTerritory) {
                 auto& territory = robot.getComponent<CTerritory>();
-                territory.shape.setRadius((float)territory.radius);
-                territory.shape.setOrigin((float)territory.radius, (float)territory.radius);
-                territory.shape.setPosition((float)territory.centre.x, (float)territory.centre.y);
-                territory.shape.setFillColor(sf::Color(0, 0, 0, 0));
-                territory.shape.setOutlineColor(territory.color);
-                territory.shape.setOutlineThickness(1);
-                m_window.draw(territory.shape);
+                r.territoryCentre = toVector(territory.centre);
+                r.territoryRadius = (float)territory.radius;
+                r.territoryColor = territory.color;
+                visible = visible || inside(view, r.territoryCentre, r.territoryRadius);
             }
+            if (visible)
+                s.robots.push_back(r);
         }
 
-        // Draw CVectorIndicator objects, which could be attached to any entity
-        for (auto e : m_sim->getWorld()->getEntities()) {
+        // CVectorIndicator objects, which could be attached to any entity
+        for (auto e : world->getEntities()) {
             if (e.hasComponent<CVectorIndicator>()) {
                 auto& vi = e.getComponent<CVectorIndicator>();
                 auto& t = e.getComponent<CTransform>();
+                if (!inside(view, toVector(t.p), (float)vi.length))
+                    continue;
 
                 double angle = vi.angle;
                 if (e.hasComponent<CVectorIndicator>()) {
@@ -418,74 +685,388 @@ private:
                     angle += steer.angle;
                 }
 
-                Vec2 start(t.p.x, t.p.y);
-                Vec2 end(t.p.x + vi.length * cos(angle),
-                         t.p.y + vi.length * sin(angle));
-                drawLine(start, end, sf::Color(vi.r, vi.g, vi.b, vi.a));
+                sf::Color color(vi.r, vi.g, vi.b, vi.a);
+                s.indicators.push_back(sf::Vertex(toVector(t.p), color));
+                s.indicators.push_back(sf::Vertex(sf::Vector2f((float)(t.p.x + vi.length * cos(angle)), (float)(t.p.y + vi.length * sin(angle))), color));
             }
         }
 
         if (m_drawLines) {
-            sf::Color lineColor(200, 200, 200);
-            for (auto& e : m_sim->getWorld()->getEntities("line")) {
+            for (auto& e : world->getEntities("line")) {
                 auto& line = e.getComponent<CLineBody>();
-
-                sf::CircleShape circle((float)line.r, 32);
-                circle.setFillColor(lineColor);
-                circle.setOrigin((float)line.r, (float)line.r);
-                circle.setOutlineColor(lineColor);
-                circle.setOutlineThickness(1);
-                circle.setPosition((float)line.s.x, (float)line.s.y);
-                m_window.draw(circle);
-                circle.setPosition((float)line.e.x, (float)line.e.y);
-                m_window.draw(circle);
-
-                Vec2 normal(-(line.e.y - line.s.y), (line.e.x - line.s.x));
-                normal = normal.normalize() * line.r;
-
-                drawLine(line.s + normal, line.e + normal, lineColor);
-                drawLine(line.s - normal, line.e - normal, lineColor);
+                sf::FloatRect bounds((float)std::min(line.s.x, line.e.x) - (float)line.r - 1, (float)std::min(line.s.y, line.e.y) - (float)line.r - 1,
+                                     (float)fabs(line.e.x - line.s.x) + 2 * (float)line.r + 2, (float)fabs(line.e.y - line.s.y) + 2 * (float)line.r + 2);
+                if (bounds.intersects(view))
+                    s.walls.push_back({ toVector(line.s), toVector(line.e), (float)line.r });
             }
         }
 
         if (m_debug) {
             for (auto& collision : m_sim->getCollisions()) {
-                drawLine(collision.t1->p, collision.t2->p, sf::Color::Green);
+                s.collisions.push_back(sf::Vertex(toVector(collision.t1->p), sf::Color::Green));
+                s.collisions.push_back(sf::Vertex(toVector(collision.t2->p), sf::Color::Green));
+            }
+        }
+
+        // Copy the rows of the visible grid images that changed since this snapshot was last taken.
+        s.grids.resize(m_gridImages.size());
+        for (size_t i = 0; i < m_gridImages.size(); i++) {
+            auto & image = m_gridImages[i];
+            auto & copy = s.grids[i];
+            copy.visible = image.visible;
+            if (!image.visible || copy.version == image.version)
+                continue;
+            if (copy.width != image.width || copy.height != image.height) {
+                copy.width = image.width;
+                copy.height = image.height;
+                copy.pixels.resize(image.pixels.size());
+                copy.rowVersions.assign(image.height, 0);
+            }
+            for (size_t y = 0; y < image.height; y++) {
+                if (copy.rowVersions[y] != image.rowVersions[y]) {
+                    memcpy(&copy.pixels[y * image.width], &image.pixels[y * image.width], image.width * sizeof(uint32_t));
+                    copy.rowVersions[y] = image.rowVersions[y];
+                }
+            }
+            copy.version = image.version;
+        }
+
+        m_snapshots.publish();
+    }
+
+    // The 256 levels of a grid image with the given colour channels, as RGBA pixels.
+    const std::vector<uint32_t> & colorTable(bool red, bool green, bool blue)
+    {
+        auto & table = m_colorTables[red * 4 + green * 2 + blue];
+        if (table.empty()) {
+            for (int level = 0; level < 256; level++) {
+                sf::Uint8 rgba[4] = { (sf::Uint8)(red ? level : 0), (sf::Uint8)(green ? level : 0), (sf::Uint8)(blue ? level : 0), 255 };
+                uint32_t pixel;
+                memcpy(&pixel, rgba, sizeof(pixel));
+                table.push_back(pixel);
+            }
+        }
+        return table;
+    }
+
+    /**
+     * Convert a grid into its image, row by row: each value becomes level
+     * (value - offset) * scale * 255, clamped to [0, 255], and the pixel of that level in
+     * the colour table.  Rows whose pixels change get a new version.
+     */
+    void convertGrid(const ValueGrid & grid, double offset, double scale, const std::vector<uint32_t> & table, RenderSnapshot::Grid & image)
+    {
+        size_t w = grid.width(), h = grid.height();
+        if (image.width != w || image.height != h) {
+            image.width = w;
+            image.height = h;
+            image.pixels.assign(w * h, 0);
+            image.rowVersions.assign(h, 0);
+        }
+
+        uint64_t version = m_gridVersion + 1;
+        bool changed = false;
+        const double * values = grid.getValues().data();
+        const uint32_t * colors = table.data();
+        double levels = 255 * scale;
+        m_rowPixels.resize(w);
+        for (size_t y = 0; y < h; y++) {
+            const double * in = values + y * w;
+            uint32_t * row = m_rowPixels.data();
+            for (size_t x = 0; x < w; x++) {
+                double level = (in[x] - offset) * levels;
+                row[x] = colors[level > 0 ? (level < 255 ? (size_t)level : 255) : 0];
+            }
+
+            uint32_t * out = &image.pixels[y * w];
+            if (memcmp(out, row, w * sizeof(uint32_t)) != 0 || image.rowVersions[y] == 0) {
+                memcpy(out, row, w * sizeof(uint32_t));
+                image.rowVersions[y] = version;
+                changed = true;
+            }
+        }
+        if (changed)
+            image.version = m_gridVersion = version;
+    }
+
+    void appendLine(sf::VertexArray & batch, sf::Vector2f p1, sf::Vector2f p2, sf::Color color)
+    {
+        batch.append(sf::Vertex(p1, color));
+        batch.append(sf::Vertex(p2, color));
+    }
+
+    // The corners of a unit circle with the given number of points, as sf::CircleShape places them.
+    const std::vector<sf::Vector2f> & unitCircle(size_t points)
+    {
+        auto & corners = m_unitCircles[points];
+        if (corners.empty()) {
+            for (size_t i = 0; i < points; i++) {
+                double angle = i * 2 * M_PI / points - M_PI / 2;
+                corners.push_back(sf::Vector2f((float)cos(angle), (float)sin(angle)));
+            }
+        }
+        return corners;
+    }
+
+    // A filled circle as triangles around its centre.
+    void appendCircle(sf::VertexArray & batch, sf::Vector2f centre, float r, sf::Color color, size_t points = 32)
+    {
+        const auto & corners = unitCircle(points);
+        for (size_t i = 0; i < points; i++) {
+            const sf::Vector2f & a = corners[i];
+            const sf::Vector2f & b = corners[(i + 1) % points];
+            batch.append(sf::Vertex(centre, color));
+            batch.append(sf::Vertex(sf::Vector2f(centre.x + r * a.x, centre.y + r * a.y), color));
+            batch.append(sf::Vertex(sf::Vector2f(centre.x + r * b.x, centre.y + r * b.y), color));
+        }
+    }
+
+    // The outline of a circle as line segments.
+    void appendCircleOutline(sf::VertexArray & batch, sf::Vector2f c, float r, sf::Color color, size_t points = 32)
+    {
+        const auto & corners = unitCircle(points);
+        for (size_t i = 0; i < points; i++) {
+            const sf::Vector2f & a = corners[i];
+            const sf::Vector2f & b = corners[(i + 1) % points];
+            batch.append(sf::Vertex(sf::Vector2f(c.x + r * a.x, c.y + r * a.y), color));
+            batch.append(sf::Vertex(sf::Vector2f(c.x + r * b.x, c.y + r * b.y), color));
+        }
+    }
+
+    /**
+     * Draw a snapshot.  Everything but the status area is put into a few vertex arrays and
+     * drawn with one call each, so that the number of draw calls does not grow with the
+     * number of bodies.  The layers, bottom to top: plows, circles and tiles, velocity lines,
+     * the background images, the heatmap, sensors and wall ends, then all other lines.
+     */
+    void render(const RenderSnapshot & s, bool newFrame)
+    {
+        m_window.clear();
+        sf::View view(s.view);
+        view.setViewport(sf::FloatRect(0, 0, 1, (float)m_arenaHeight / m_windowHeight));
+        m_window.setView(view);
+        m_bodyTriangles.clear();
+        m_bodyLines.clear();
+        m_overlayTriangles.clear();
+        m_overlayLines.clear();
+
+        for (auto & v : s.plows)
+            m_bodyTriangles.append(v);
+
+        if (s.drawCircles) {
+            for (auto & body : s.bodies) {
+                appendCircle(m_bodyTriangles, body.p, body.r, body.color, body.points);
+                if (body.moving)
+                    appendLine(m_bodyLines, body.p, body.velocityEnd, sf::Color(255, 255, 255));
+            }
+        }
+
+        for (auto & v : s.tiles)
+            m_bodyTriangles.append(v);
+
+        m_window.draw(m_bodyTriangles);
+        m_window.draw(m_bodyLines);
+
+        // Draw all active background images, which are blended together
+        m_gridTextures.resize(s.grids.size());
+        for (size_t i = 0; i < s.grids.size(); i++) {
+            if (s.grids[i].visible) {
+                uploadGrid(s.grids[i], m_gridTextures[i]);
+                m_gridSprite.setTexture(m_gridTextures[i].texture, true);
+                m_window.draw(m_gridSprite, sf::RenderStates(sf::BlendAdd));
+            }
+        }
+
+        for (auto & v : s.heatmap)
+            m_overlayTriangles.append(v);
+
+        if (s.drawSensors) {
+            sf::Color detectColor(0, 0, 255, 100);
+            sf::Color noDetectColor(0, 0, 127, 100);
+            for (auto & sensor : s.sensors) {
+                appendCircle(m_overlayTriangles, sensor.p, sensor.r, sensor.detected ? detectColor : noDetectColor);
+                if (sensor.detected)
+                    appendCircleOutline(m_overlayLines, sensor.p, sensor.r, sf::Color::White);
             }
         }
 
+        for (auto & robot : s.robots) {
+            // A line corresponding to this robot's heading.
+            float r = robot.r;
+            appendLine(m_overlayLines, robot.p, sf::Vector2f(robot.p.x + r * cos(robot.angle), robot.p.y + r * sin(robot.angle)), sf::Color(0, 0, 0));
+
+            // If the robot is selected, an outline around it.
+            if (robot.selected) {
+                sf::Vector2f corners[] = { sf::Vector2f(robot.p.x - r, robot.p.y - r), sf::Vector2f(robot.p.x + r, robot.p.y - r),
+                                           sf::Vector2f(robot.p.x + r, robot.p.y + r), sf::Vector2f(robot.p.x - r, robot.p.y + r) };
+                for (size_t i = 0; i < 4; i++)
+                    appendLine(m_overlayLines, corners[i], corners[(i + 1) % 4], sf::Color::White);
+            }
+
+            if (robot.hasTerritory)
+                appendCircleOutline(m_overlayLines, robot.territoryCentre, robot.territoryRadius, robot.territoryColor);
+        }
+
+        for (auto & v : s.indicators)
+            m_overlayLines.append(v);
+
+        sf::Color lineColor(200, 200, 200);
+        for (auto & wall : s.walls) {
+            // Round ends, including their 1 pixel outline.
+            appendCircle(m_overlayTriangles, wall.s, wall.r + 1, lineColor);
+            appendCircle(m_overlayTriangles, wall.e, wall.r + 1, lineColor);
+
+            Vec2 normal(-(wall.e.y - wall.s.y), (wall.e.x - wall.s.x));
+            normal = normal.normalize() * wall.r;
+            sf::Vector2f n = toVector(normal);
+
+            appendLine(m_overlayLines, sf::Vector2f(wall.s.x + n.x, wall.s.y + n.y), sf::Vector2f(wall.e.x + n.x, wall.e.y + n.y), lineColor);
+            appendLine(m_overlayLines, sf::Vector2f(wall.s.x - n.x, wall.s.y - n.y), sf::Vector2f(wall.e.x - n.x, wall.e.y - n.y), lineColor);
+        }
+
+        for (auto & v : s.collisions)
+            m_overlayLines.append(v);
+
+        m_window.draw(m_overlayTriangles);
+        m_window.draw(m_overlayLines);
+
         // Draw "controls" area at the bottom of the screen.
+        m_window.setView(m_window.getDefaultView());
         sf::RectangleShape rect(sf::Vector2f(m_windowWidth, m_controlsHeight));
-        rect.setPosition(0, m_sim->getWorld()->height());
+        rect.setPosition(0, m_arenaHeight);
         rect.setFillColor(sf::Color(100, 100, 100, 255));
         m_window.draw(rect);
 
         // Draw the status text
         sf::Text text;
         text.setFont(m_font);
-        text.setString(m_status);
+        text.setString(s.status);
         text.setCharacterSize(12);
-        text.setPosition(5, (float)m_sim->getWorld()->height());// + text.getLocalBounds().height);
+        text.setPosition(5, (float)m_arenaHeight);// + text.getLocalBounds().height);
         m_window.draw(text);
 
+        if (newFrame && !m_videoFilename.empty())
+            captureFrame();
+
         m_window.display();
     }
 
+    // Upload the runs of rows of a grid image that differ from those its texture holds.
+    void uploadGrid(const RenderSnapshot::Grid & grid, GridTexture & texture)
+    {
+        if (texture.texture.getSize() != sf::Vector2u(grid.width, grid.height)) {
+            texture.texture.create(grid.width, grid.height);
+            texture.rowVersions.assign(grid.height, 0);
+        }
+        for (size_t y = 0; y < grid.height; ) {
+            if (texture.rowVersions[y] == grid.rowVersions[y]) {
+                y++;
+                continue;
+            }
+            size_t end = y + 1;
+            while (end < grid.height && texture.rowVersions[end] != grid.rowVersions[end])
+                end++;
+            texture.texture.update((const sf::Uint8 *)&grid.pixels[y * grid.width], grid.width, end - y, 0, y);
+            std::copy(grid.rowVersions.begin() + y, grid.rowVersions.begin() + end, texture.rowVersions.begin() + y);
+            y = end;
+        }
+    }
+
+    /**
+     * Copy the window's contents into the video recorder's next buffer, which is opened at
+     * the first frame.  The pixels are read back only if there is a buffer for them, and
+     * straight into it, so a frame costs no allocation or extra copy; the encoding and
+     * writing happen on the recorder's thread.  This must be called before display(), while
+     * the back buffer holds the frame.
+     */
+    void captureFrame()
+    {
+        sf::Vector2u size = m_window.getSize();
+        if (!m_video)
+            m_video.reset(new VideoRecorder(m_videoFilename, size.x, size.y, m_videoFrameRate));
+        uint8_t * frame = m_video->beginFrame();
+        if (!frame)
+            return;
+
+        // The video keeps the size of its first frame, taken from the top left of the window.
+        size_t width = std::min((size_t)size.x, m_video->width());
+        size_t height = std::min((size_t)size.y, m_video->height());
+        size_t rowBytes = 4 * m_video->width();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)m_video->width());
+        glReadPixels(0, (GLint)(size.y - height), (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, frame);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+        // OpenGL gives the bottom row first.
+        for (size_t y = 0; y < height / 2; y++)
+            std::swap_ranges(frame + y * rowBytes, frame + y * rowBytes + 4 * width, frame + (height - 1 - y) * rowBytes);
+        m_video->endFrame();
+    }
+
+    /**
+     * The render thread: it owns the window, queues the window's events for the simulation
+     * thread, and draws the latest snapshot at the window's frame rate.  Events that do not
+     * fit in the queue are dropped rather than wait.
+     */
+    void renderLoop()
+    {
+        createWindow();
+        while (!m_stopRendering) {
+            sf::Event event;
+            while (m_window.pollEvent(event)) {
+                if (sf::Event * slot = m_events.beginPush()) {
+                    *slot = event;
+                    m_events.endPush();
+                }
+            }
+            bool newFrame = m_snapshots.update();
+            if (m_snapshots.front().width > 0)
+                render(m_snapshots.front(), newFrame);
+            else
+                sf::sleep(sf::milliseconds(10));
+        }
+        m_window.close();
+    }
+
+    void stopRenderThread()
+    {
+        if (m_renderThread.joinable() && m_renderThread.get_id() != std::this_thread::get_id()) {
+            m_stopRendering = true;
+            m_renderThread.join();
+        }
+    }
+
 public:
-    GUI(std::shared_ptr<Simulator> sim, size_t fps)
+    /**
+     * With a video filename, every frame drawn from a new snapshot is recorded to it (see
+     * VideoRecorder) until the GUI is closed.
+     */
+    GUI(std::shared_ptr<Simulator> sim, size_t fps, bool renderThread = false, const std::string & videoFilename = "", size_t videoFrameRate = 30)
         : m_sim(sim)
+        , m_fps(fps)
+        , m_threaded(renderThread)
+        , m_videoFilename(videoFilename)
+        , m_videoFrameRate(videoFrameRate)
     {
-        m_windowWidth = m_sim->getWorld()->width();
-        m_windowHeight = m_sim->getWorld()->height() + m_controlsHeight;
-        m_window.create(sf::VideoMode(m_windowWidth, m_windowHeight), "CWaggle", sf::Style::Titlebar | sf::Style::Close);
-        m_window.setFramerateLimit(fps);
-
-        // Scale the window size up for high-res screens.
-        double scaleFactor = 1;
-        size_t scaledWindowWidth = scaleFactor * m_windowWidth;
-        size_t scaledWindowHeight = scaleFactor * m_windowHeight;
-        m_window.setSize(sf::Vector2u(scaledWindowWidth, scaledWindowHeight));
+        // The arena at one pixel per unit, or scaled down to fit the screen.
+        double width = m_sim->getWorld()->width(), height = m_sim->getWorld()->height();
+        sf::VideoMode desktop = sf::VideoMode::getDesktopMode();
+        double scale = std::min({ 1.0, 0.9 * desktop.width / width, (0.9 * desktop.height - m_controlsHeight) / height });
+        m_arenaWidth = std::max((size_t)(width * scale), (size_t)1);
+        m_arenaHeight = std::max((size_t)(height * scale), (size_t)1);
+        m_windowWidth = m_arenaWidth;
+        m_windowHeight = m_arenaHeight + m_controlsHeight;
         init(sim);
+        fitView();
+        if (m_threaded)
+            m_renderThread = std::thread(&GUI::renderLoop, this);
+        else
+            createWindow();
+    }
+
+    ~GUI()
+    {
+        stopRenderThread();
     }
 
     void setStatus(const std::string& str)
@@ -501,39 +1082,46 @@ public:
     void update()
     {
         sUserInput();
-        sRender();
+        publish();
+        if (!m_threaded) {
+            m_snapshots.update();
+            render(m_snapshots.front(), true);
+        }
     }
 
     void close()
     {
-        m_window.close();
+        if (m_threaded)
+            stopRenderThread();
+        else
+            m_window.close();
+        m_video.reset();
     }
 
+    /**
+     * Show a grid normalized to [0, 1], in the given colour channels.  Grids that are not
+     * shown are left as they are, so showing one takes effect at its next update.
+     */
     void updateGridImage(int gridIndex, bool red, bool green, bool blue)
     {
-        // Get a copy of the grid and normalize it.
-        ValueGrid grid{m_sim->getWorld()->getGrid(gridIndex)};
-        grid.normalize();
-
-        int w = grid.width();
-        int h = grid.height();
-
-        auto& gridImage = m_backgroundImages[gridIndex].first;
-
-        for (size_t x = 0; x < w; x++) {
-            for (size_t y = 0; y < h; y++) {
-                uint8_t value = (uint8_t)(grid.get(x, y) * 255);
-                uint8_t r=0, g=0, b=0;
-                if (red)
-                    r = value;
-                if (green)
-                    g = value;
-                if (blue)
-                    b = value;
-                sf::Color color(r, g, b);
-                gridImage.setPixel(x, y, color);
-            }
-        }
+        auto& image = m_gridImages[gridIndex];
+        if (!image.visible)
+            return;
+
+        // As ValueGrid::normalize, without changing or copying the grid.
+        const auto& grid = m_sim->getWorld()->getGrid(gridIndex);
+        const auto& values = grid.getValues();
+        if (values.empty())
+            return;
+        auto range = std::minmax_element(values.begin(), values.end());
+        double extent = *range.second - *range.first;
+        convertGrid(grid, *range.first, extent == 0 ? 1 : 1 / extent, colorTable(red, green, blue), image);
+    }
+
+    // The heatmap the O key shows, which must outlive the GUI or be unset.
+    void setHeatmap(const Heatmap * heatmap)
+    {
+        m_heatmap = heatmap;
     }
 
     void setKeyboardCallback(KeyboardCallback* keyboardCallback)
@@ -541,8 +1129,13 @@ public:
         m_keyboardCallback = keyboardCallback;
     }
 
+    // Save the window's contents.  Only available without a render thread.
     void saveScreenshot(std::string filename)
     {
+        if (m_threaded) {
+            std::cerr << "Screenshots need the GUI without a render thread\n";
+            return;
+        }
         //sf::Image screenshot = m_window.capture();
         //screenshot.saveToFile(filename);
         sf::Texture texture;
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * How often each cell of a grid over the world is occupied, accumulated one sample at a
+ * time: add() each entity's position, then endSample().  Two maps are kept, both as the
+ * mean number of entities in a cell per sample: a cumulative one over all samples, and a
+ * decayed one in which a sample's weight halves every 'halfLife' samples, showing where
+ * the entities have been lately.
+ *
+ * Updates cost a little per entity, not per cell: rather than scale the decayed map down
+ * every sample, new samples are weighted up, and the map is rescaled only when the weight
+ * grows large.
+ */
+class Heatmap
+{
+    double m_cellSize = 1;
+    size_t m_cols = 0, m_rows = 0;
+    double m_decay = 1;                 // the factor applied to the decayed map per sample
+    std::vector<double> m_cumulative;   // entity counts
+    std::vector<double> m_decayed;      // entity counts weighted by m_weight when added
+    double m_samples = 0;
+    double m_decayedSamples = 0;        // the samples, weighted as m_decayed
+    double m_weight = 1;                // the weight of the current sample
+
+public:
+    Heatmap() {}
+
+    Heatmap(double width, double height, double cellSize, double halfLife)
+        : m_cellSize(cellSize)
+        , m_cols((size_t)ceil(width / cellSize))
+        , m_rows((size_t)ceil(height / cellSize))
+        , m_decay(halfLife > 0 ? pow(0.5, 1 / halfLife) : 1)
+        , m_cumulative(m_cols * m_rows, 0)
+        , m_decayed(m_cols * m_rows, 0)
+    {
+    }
+
+    size_t cols() const
+    {
+        return m_cols;
+    }
+
+    size_t rows() const
+    {
+        return m_rows;
+    }
+
+    double cellSize() const
+    {
+        return m_cellSize;
+    }
+
+    double samples() const
+    {
+        return m_samples;
+    }
+
+    // Count an entity at (x, y) in the current sample.  Positions outside the grid are ignored.
+    void add(double x, double y)
+    {
+        if (!(x >= 0 && y >= 0))
+            return;
+        size_t col = (size_t)(x / m_cellSize), row = (size_t)(y / m_cellSize);
+        if (col >= m_cols || row >= m_rows)
+            return;
+        m_cumulative[row * m_cols + col] += 1;
+        m_decayed[row * m_cols + col] += m_weight;
+    }
+
+    void endSample()
+    {
+        m_samples += 1;
+        m_decayedSamples += m_weight;
+        m_weight /= m_decay;
+        if (m_weight > 1e100) {
+            for (auto & value : m_decayed)
+                value /= m_weight;
+            m_decayedSamples /= m_weight;
+            m_weight = 1;
+        }
+    }
+
+    double cumulative(size_t col, size_t row) const
+    {
+        return m_samples > 0 ? m_cumulative[row * m_cols + col] / m_samples : 0;
+    }
+
+    double decayed(size_t col, size_t row) const
+    {
+        return m_decayedSamples > 0 ? m_decayed[row * m_cols + col] / m_decayedSamples : 0;
+    }
+
+    /**
+     * Add another map, e.g. a trial's, with the same grid, as one sample: the maps of the
+     * sum are then the means of the maps added.
+     */
+    void accumulate(const Heatmap & other)
+    {
+        if (other.m_cumulative.empty())
+            return;
+        if (m_cumulative.empty()) {
+            m_cellSize = other.m_cellSize;
+            m_cols = other.m_cols;
+            m_rows = other.m_rows;
+            m_cumulative.assign(m_cols * m_rows, 0);
+            m_decayed.assign(m_cols * m_rows, 0);
+        }
+        if (other.m_cols != m_cols || other.m_rows != m_rows)
+            return;
+        for (size_t row = 0; row < m_rows; row++) {
+            for (size_t col = 0; col < m_cols; col++) {
+                m_cumulative[row * m_cols + col] += other.cumulative(col, row);
+                m_decayed[row * m_cols + col] += other.decayed(col, row);
+            }
+        }
+        m_samples += 1;
+        m_decayedSamples += 1;
+    }
+
+    /**
+     * Read back a map from the cumulative and decayed grids written by write(), as one
+     * sample whose maps are those grids (to the precision they were written with).
+     */
+    bool read(std::istream & cumulativeIn, std::istream & decayedIn, double cellSize)
+    {
+        Heatmap map;
+        map.m_cellSize = cellSize;
+        map.m_samples = map.m_decayedSamples = 1;
+        std::string cumulativeLine, decayedLine;
+        while (std::getline(cumulativeIn, cumulativeLine)) {
+            if (!std::getline(decayedIn, decayedLine))
+                return false;
+            std::istringstream cumulativeRow(cumulativeLine), decayedRow(decayedLine);
+            size_t cols = 0;
+            double c, d;
+            while (cumulativeRow >> c && decayedRow >> d) {
+                map.m_cumulative.push_back(c);
+                map.m_decayed.push_back(d);
+                cols++;
+            }
+            if (cols == 0 || (map.m_rows > 0 && cols != map.m_cols))
+                return false;
+            map.m_cols = cols;
+            map.m_rows++;
+        }
+        if (map.m_rows == 0)
+            return false;
+        *this = map;
+        return true;
+    }
+
+    /**
+     * Save the whole state, to be restored exactly by load(): the grid, the sample counts
+     * and weights, then the cumulative and the decayed cells.
+     */
+    void save(std::ostream & out) const
+    {
+        auto oldPrecision = out.precision(17);
+        out << m_cols << " " << m_rows << " " << m_cellSize << " " << m_decay << " "
+            << m_samples << " " << m_decayedSamples << " " << m_weight << "\n";
+        for (size_t i = 0; i < m_cumulative.size(); i++)
+            out << (i > 0 ? " " : "") << m_cumulative[i];
+        out << "\n";
+        for (size_t i = 0; i < m_decayed.size(); i++)
+            out << (i > 0 ? " " : "") << m_decayed[i];
+        out << "\n";
+        out.precision(oldPrecision);
+    }
+
+    bool load(std::istream & in)
+    {
+        Heatmap map;
+        if (!(in >> map.m_cols >> map.m_rows >> map.m_cellSize >> map.m_decay
+                 >> map.m_samples >> map.m_decayedSamples >> map.m_weight))
+            return false;
+        map.m_cumulative.resize(map.m_cols * map.m_rows);
+        map.m_decayed.resize(map.m_cols * map.m_rows);
+        for (auto & value : map.m_cumulative)
+            in >> value;
+        for (auto & value : map.m_decayed)
+            in >> value;
+        if (!in)
+            return false;
+        *this = map;
+        return true;
+    }
+
+    /**
+     * Write the cumulative or the decayed map as text, a line per row of cells, so that it
+     * loads with numpy.loadtxt.
+     */
+    void write(std::ostream & out, bool decayedMap) const
+    {
+        for (size_t row = 0; row < m_rows; row++) {
+            for (size_t col = 0; col < m_cols; col++)
+                out << (col > 0 ? " " : "") << (decayedMap ? decayed(col, row) : cumulative(col, row));
+            out << "\n";
+        }
+    }
+
+    // As above, to a file that is replaced atomically.  False on failure.
+    bool write(const std::string & filename, bool decayedMap) const
+    {
+        std::string tmp = filename + ".tmp";
+        std::ofstream fout(tmp);
+        write(fout, decayedMap);
+        fout.close();
+        if (!fout || rename(tmp.c_str(), filename.c_str()) != 0) {
+            remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
@@ -9,6 +9,7 @@
 #include "Timer.hpp"
 #include "World.hpp"
 #include "Components.hpp"
+#include "Telemetry.hpp"
 
 #define SLOWED_ROBOT_COUNT 100
 
@@ -42,6 +43,11 @@ class Simulator
 
     std::vector<Entity>         m_collisionEntities;
 
+    Telemetry *                 m_telemetry = nullptr;
+    Telemetry::Slot             m_collisionsSlot;
+    Telemetry::Slot             m_wallCollisionsSlot;
+    size_t                      m_wallCollisions = 0;
+
     void movement()
     {
         // update entity's velocity from its heading and angle
@@ -83,6 +89,7 @@ class Simulator
         m_collisions.clear();
         m_fakeBodies.clear();
         m_fakeTransforms.clear();
+        m_wallCollisions = 0;
 
         // we can skip collision checking for any circle that hasn't moved
         // static resolution doesn't alter speed, so movement not recorded
@@ -124,6 +131,7 @@ class Simulator
                     // If this circlebody belongs to a robot, then slow it
                     auto & steer1 = e1.getComponent<CSteer>();
                     steer1.slowedCount = SLOWED_ROBOT_COUNT;
+                    m_wallCollisions++;
                 }
             }
 
@@ -364,6 +372,26 @@ appendTo(m_world->getEntities("green_puck"), m_collisionEntities);
         // do the actual simulation
         movement();
         collisions();
+
+        if (m_telemetry) {
+            m_telemetry->set(m_collisionsSlot, m_collisions.size());
+            m_telemetry->set(m_wallCollisionsSlot, m_wallCollisions);
+        }
+    }
+
+    // Report the number of collisions found by each update as the "collisions" column, and
+    // those of robots with walls as "wallCollisions".
+    void registerTelemetry(Telemetry & telemetry)
+    {
+        m_telemetry = &telemetry;
+        m_collisionsSlot = telemetry.add("collisions", Telemetry::INT32);
+        m_wallCollisionsSlot = telemetry.add("wallCollisions", Telemetry::INT32);
+    }
+
+    // The number of robot collisions with walls in the last update.
+    size_t getWallCollisions() const
+    {
+        return m_wallCollisions;
     }
 
     // TODO: remove this, make sim world only on constructor
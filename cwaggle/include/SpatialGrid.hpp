@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * A uniform grid of buckets over a rectangle from (0, 0), indexing items by a point each.
+ * Build it with reset(), insert() for each item, then build(); after that the items of a
+ * cell, or of the cells a rectangle overlaps, can be visited without looking at the rest.
+ * Points outside the rectangle go to the nearest edge cell, so every item is found.
+ *
+ * Building is a counting sort of the items into one array, so rebuilding costs a pass over
+ * the items and no allocation once the arrays have grown.
+ */
+class SpatialGrid
+{
+public:
+    struct Item
+    {
+        float x, y;
+        size_t index;
+    };
+
+private:
+    double m_cellSize = 1;
+    size_t m_cols = 0, m_rows = 0;
+    std::vector<Item> m_pending;
+    std::vector<size_t> m_starts;   // the items of cell c are m_items[m_starts[c]] to m_items[m_starts[c + 1] - 1]
+    std::vector<Item> m_items;
+    std::vector<size_t> m_next;     // the next free slot of each cell while building
+
+    size_t clampCell(double v, size_t n) const
+    {
+        double c = floor(v / m_cellSize);
+        return c <= 0 ? 0 : (c >= n ? n - 1 : (size_t)c);
+    }
+
+public:
+    // Start again with cells of the given size over a width * height rectangle.
+    void reset(double width, double height, double cellSize)
+    {
+        m_cellSize = cellSize;
+        m_cols = std::max((size_t)ceil(width / cellSize), (size_t)1);
+        m_rows = std::max((size_t)ceil(height / cellSize), (size_t)1);
+        m_pending.clear();
+        m_items.clear();
+        m_starts.assign(m_cols * m_rows + 1, 0);
+    }
+
+    // Add an item at (x, y); items at NaN positions are left out.
+    void insert(size_t index, double x, double y)
+    {
+        if (std::isnan(x) || std::isnan(y))
+            return;
+        m_pending.push_back({ (float)x, (float)y, index });
+    }
+
+    void build()
+    {
+        std::fill(m_starts.begin(), m_starts.end(), 0);
+        for (auto & item : m_pending)
+            m_starts[cellOf(item.x, item.y) + 1]++;
+        for (size_t c = 1; c < m_starts.size(); c++)
+            m_starts[c] += m_starts[c - 1];
+        m_items.resize(m_pending.size());
+        m_next.assign(m_starts.begin(), m_starts.end() - 1);
+        for (auto & item : m_pending)
+            m_items[m_next[cellOf(item.x, item.y)]++] = item;
+    }
+
+    double cellSize() const
+    {
+        return m_cellSize;
+    }
+
+    size_t cols() const
+    {
+        return m_cols;
+    }
+
+    size_t rows() const
+    {
+        return m_rows;
+    }
+
+    size_t cellOf(double x, double y) const
+    {
+        return clampCell(y, m_rows) * m_cols + clampCell(x, m_cols);
+    }
+
+    // The first and one past the last items of a cell.
+    const Item * begin(size_t col, size_t row) const
+    {
+        return m_items.data() + m_starts[row * m_cols + col];
+    }
+
+    const Item * end(size_t col, size_t row) const
+    {
+        return m_items.data() + m_starts[row * m_cols + col + 1];
+    }
+
+    // The columns and rows of the cells a rectangle overlaps, from c0, r0 to c1, r1 inclusive.
+    void cellRange(double left, double top, double right, double bottom, size_t & c0, size_t & r0, size_t & c1, size_t & r1) const
+    {
+        c0 = clampCell(left, m_cols);
+        r0 = clampCell(top, m_rows);
+        c1 = clampCell(right, m_cols);
+        r1 = clampCell(bottom, m_rows);
+    }
+
+    // Call f(item) for every item whose point lies in the rectangle.
+    template <class F>
+    void query(double left, double top, double right, double bottom, F f) const
+    {
+        if (m_items.empty())
+            return;
+        size_t c0, r0, c1, r1;
+        cellRange(left, top, right, bottom, c0, r0, c1, r1);
+        for (size_t row = r0; row <= r1; row++) {
+            for (size_t col = c0; col <= c1; col++) {
+                for (const Item * item = begin(col, row); item != end(col, row); item++) {
+                    if (item->x >= left && item->x <= right && item->y >= top && item->y <= bottom)
+                        f(*item);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * A bounded lock-free ring buffer for exactly one producer thread and one consumer thread.
+ * The slots are allocated up front and reused, so elements are filled in place: the
+ * producer fills the slot returned by beginPush() and then calls endPush(), and the
+ * consumer reads front() and then calls pop().  The capacity is rounded up to a power of 2.
+ */
+template <typename T>
+class SpscRing
+{
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    // Kept on separate cache lines, as each is written by a different thread.
+    alignas(64) std::atomic<size_t> m_head{ 0 };   // next slot to be written
+    alignas(64) std::atomic<size_t> m_tail{ 0 };   // next slot to be read
+
+public:
+    SpscRing(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        m_slots.resize(size);
+        m_mask = size - 1;
+    }
+
+    size_t capacity() const
+    {
+        return m_slots.size();
+    }
+
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // Producer: the slot to fill next, or null if the ring is full.
+    T * beginPush()
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == m_slots.size())
+            return nullptr;
+        return &m_slots[head & m_mask];
+    }
+
+    // Producer: make the slot returned by beginPush() visible to the consumer.
+    void endPush()
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer: the oldest element, or null if the ring is empty.
+    T * front()
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return nullptr;
+        return &m_slots[tail & m_mask];
+    }
+
+    // Consumer: release the element returned by front() for reuse.
+    void pop()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A small work-stealing thread pool.  Each worker owns a deque: it pushes and pops its own
+ * work at the back, and when that runs dry it steals from the front of the others.  Threads
+ * which are waiting on the pool (see TaskGraph::wait) help by stealing too.
+ */
+class WorkStealingPool
+{
+    struct Queue
+    {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<size_t> m_queued{ 0 };
+    std::atomic<size_t> m_nextQueue{ 0 };
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+
+    // The index of the pool worker running on this thread, or -1 for outside threads.
+    static int & workerIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    bool popFrom(size_t q, bool back, std::function<void()> & task)
+    {
+        std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+        auto & tasks = m_queues[q]->tasks;
+        if (tasks.empty())
+            return false;
+        if (back) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        } else {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        m_queued--;
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        workerIndex() = index;
+        while (!m_stop) {
+            if (runOne())
+                continue;
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+        }
+    }
+
+public:
+    WorkStealingPool(size_t numThreads)
+    {
+        for (size_t i = 0; i < numThreads; i++)
+            m_queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < numThreads; i++)
+            m_threads.emplace_back(&WorkStealingPool::workerLoop, this, (int)i);
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto & t : m_threads)
+            t.join();
+    }
+
+    size_t size() const
+    {
+        return m_threads.size();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        int self = workerIndex();
+        size_t q = self >= 0 ? (size_t)self : m_nextQueue++ % m_queues.size();
+        {
+            std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+            m_queues[q]->tasks.push_back(std::move(task));
+            m_queued++;
+        }
+        {
+            // Taking the lock orders this with a worker deciding to sleep.
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+        }
+        m_wake.notify_one();
+    }
+
+    /**
+     * Run one queued task on the calling thread, preferring this worker's own queue.
+     * Returns false if there was nothing to run.
+     */
+    bool runOne()
+    {
+        std::function<void()> task;
+        int self = workerIndex();
+        bool found = self >= 0 && popFrom(self, true, task);
+        for (size_t i = 0; !found && i < m_queues.size(); i++) {
+            size_t victim = (self + 1 + i) % m_queues.size();
+            found = popFrom(victim, false, task);
+        }
+        if (found)
+            task();
+        return found;
+    }
+};
+
+/**
+ * A fixed directed acyclic graph of tasks.  The graph is built once and can then be run
+ * any number of times: each run starts the nodes without dependencies, and a node is
+ * started as soon as all of its dependencies have finished.  Without a pool (or with an
+ * empty one) the nodes simply run in the order they were added, which must therefore be
+ * a topological order.
+ */
+class TaskGraph
+{
+    struct Node
+    {
+        std::string name;
+        std::function<void()> fn;
+        std::vector<size_t> successors;
+        size_t numDependencies = 0;
+        std::atomic<size_t> remaining{ 0 };
+    };
+
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    std::atomic<size_t> m_unfinished{ 0 };
+    WorkStealingPool * m_pool = nullptr;
+
+    void startNode(size_t index)
+    {
+        m_pool->submit([this, index] {
+            Node & node = *m_nodes[index];
+            node.fn();
+            for (size_t s : node.successors) {
+                if (--m_nodes[s]->remaining == 0)
+                    startNode(s);
+            }
+            m_unfinished--;
+        });
+    }
+
+public:
+    /**
+     * Add a node which runs 'fn' after all of the given nodes have finished.  Returns the
+     * index used to refer to the new node as a dependency.
+     */
+    size_t add(const std::string & name, std::function<void()> fn, const std::vector<size_t> & dependencies = {})
+    {
+        size_t index = m_nodes.size();
+        m_nodes.push_back(std::make_unique<Node>());
+        m_nodes.back()->name = name;
+        m_nodes.back()->fn = std::move(fn);
+        m_nodes.back()->numDependencies = dependencies.size();
+        for (size_t d : dependencies)
+            m_nodes[d]->successors.push_back(index);
+        return index;
+    }
+
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+    void clear()
+    {
+        wait();
+        m_nodes.clear();
+    }
+
+    /**
+     * Start a run of the graph.  With a pool this returns immediately and wait() must be
+     * called before the graph is started again; otherwise the whole graph runs here.
+     */
+    void start(WorkStealingPool * pool)
+    {
+        wait();
+        if (pool == nullptr || pool->size() == 0) {
+            for (auto & node : m_nodes)
+                node->fn();
+            return;
+        }
+
+        m_pool = pool;
+        m_unfinished = m_nodes.size();
+        for (auto & node : m_nodes)
+            node->remaining = node->numDependencies;
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            if (m_nodes[i]->numDependencies == 0)
+                startNode(i);
+        }
+    }
+
+    // Block until the current run has finished, helping with queued work meanwhile.
+    void wait()
+    {
+        while (m_unfinished > 0) {
+            if (!m_pool->runOne())
+                std::this_thread::yield();
+        }
+    }
+
+    void run(WorkStealingPool * pool)
+    {
+        start(pool);
+        wait();
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * A registry of named, typed telemetry columns.  Whatever produces a metric (a controller,
+ * the Simulator, the evaluation) registers a column once and keeps the Slot it gets back;
+ * from then on it stores the metric's latest value with set(), which is a plain array
+ * write.  Sinks (loggers, aggregators) read the columns once to set themselves up and then
+ * take the whole frame of values with getValues() whenever they sample.
+ *
+ * Columns of the same kind from several producers, such as the tau of every robot, are
+ * registered under a common group, and getGroup() gives their slots in registration order.
+ */
+class Telemetry
+{
+public:
+    // The codes match BinaryLogWriter::ColumnType.  Values are held as doubles whatever the type.
+    enum Type : uint8_t { INT32 = 1, INT64 = 2, FLOAT64 = 3 };
+
+    struct Column
+    {
+        std::string name;
+        Type type;
+        std::string group;
+    };
+
+    struct Slot
+    {
+        size_t index = SIZE_MAX;
+
+        bool valid() const
+        {
+            return index != SIZE_MAX;
+        }
+    };
+
+private:
+    std::vector<Column> m_columns;
+    std::vector<double> m_values;
+    std::map<std::string, std::vector<size_t>> m_groups;
+    std::vector<size_t> m_noSlots;
+
+public:
+    Slot add(const std::string & name, Type type = FLOAT64, const std::string & group = "")
+    {
+        Slot slot;
+        slot.index = m_columns.size();
+        m_columns.push_back({ name, type, group });
+        m_values.push_back(0);
+        if (!group.empty())
+            m_groups[group].push_back(slot.index);
+        return slot;
+    }
+
+    void set(Slot slot, double value)
+    {
+        m_values[slot.index] = value;
+    }
+
+    double get(Slot slot) const
+    {
+        return m_values[slot.index];
+    }
+
+    const std::vector<Column> & getColumns() const
+    {
+        return m_columns;
+    }
+
+    // The latest value of every column, indexed by Slot::index.
+    const std::vector<double> & getValues() const
+    {
+        return m_values;
+    }
+
+    // The slot indices of the group's columns, in the order registered.
+    const std::vector<size_t> & getGroup(const std::string & group) const
+    {
+        auto it = m_groups.find(group);
+        return it == m_groups.end() ? m_noSlots : it->second;
+    }
+};
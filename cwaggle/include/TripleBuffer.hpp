@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Hands the latest version of a value from one writer thread to one reader thread without
+ * locks or waiting on either side.  The writer fills back() and calls publish(); the reader
+ * calls update() and then reads front(), which stays valid until its next update().  Of
+ * three buffers, one belongs to each side and the third is the one most recently published,
+ * so the writer never overwrites what the reader holds and the reader never sees a half
+ * written value.  Versions published between two updates are skipped.
+ */
+template <typename T>
+class TripleBuffer
+{
+    static const uint8_t Fresh = 4;     // set with the middle index when it holds a new version
+
+    T m_buffers[3];
+    std::atomic<uint8_t> m_middle{ 1 };
+    uint8_t m_back = 0;
+    uint8_t m_front = 2;
+
+public:
+    // The buffer for the writer to fill.  It may hold an old version, so storage can be reused.
+    T & back()
+    {
+        return m_buffers[m_back];
+    }
+
+    // Make the back buffer the latest version, and take the old middle one as the new back.
+    void publish()
+    {
+        m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & ~Fresh;
+    }
+
+    // Take the latest version as the front, if one was published since the last update.
+    bool update()
+    {
+        if (!(m_middle.load(std::memory_order_acquire) & Fresh))
+            return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~Fresh;
+        return true;
+    }
+
+    const T & front() const
+    {
+        return m_buffers[m_front];
+    }
+};
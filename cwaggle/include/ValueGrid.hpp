@@ -117,6 +117,12 @@ public:
         for (auto & val : m_values) { val = 1.0 - val; }
     }
 
+    // The values, row by row.
+    const std::vector<double> & getValues() const
+    {
+        return m_values;
+    }
+
     size_t width() const
     {
         return m_width;
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscRing.hpp"
+
+/**
+ * Records frames to a video file from a background thread.  The drawing thread copies each
+ * frame, as RGBA pixels, into a buffer of a fixed pool (beginFrame() / endFrame()), and the
+ * recorder thread encodes and writes it, so recording costs the drawing thread one copy per
+ * frame.  When every buffer is waiting to be written the frame is dropped rather than wait.
+ *
+ * A filename ending in ".y4m" is written directly as YUV4MPEG2 (4:2:0), which needs nothing
+ * else and which most players and encoders read.  Anything else is given to an ffmpeg
+ * subprocess, which reads the raw RGBA frames from a pipe and encodes them as H.264 (or
+ * whatever ffmpeg chooses for the file's extension).
+ */
+class VideoRecorder
+{
+    size_t m_width, m_height;
+    size_t m_frameBytes;
+    SpscRing<std::vector<uint8_t>> m_frames;
+    FILE * m_out = nullptr;
+    bool m_pipe = false;
+    bool m_y4m = false;
+    std::vector<uint8_t> m_yuv;
+    size_t m_written = 0, m_dropped = 0;
+    bool m_failed = false;
+    std::atomic<bool> m_stop{ false };
+    std::thread m_thread;
+
+    static std::string Quote(const std::string & text)
+    {
+        std::string quoted = "'";
+        for (char c : text)
+            quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        return quoted + "'";
+    }
+
+    // Full range BT.601, as the "C420jpeg" colour space of the Y4M header; each chroma
+    // sample is the mean of a 2x2 block (clamped at odd edges).
+    void toYuv420(const uint8_t * rgba)
+    {
+        size_t cw = (m_width + 1) / 2, ch = (m_height + 1) / 2;
+        uint8_t * y = m_yuv.data();
+        uint8_t * u = y + m_width * m_height;
+        uint8_t * v = u + cw * ch;
+        for (size_t i = 0; i < m_width * m_height; i++) {
+            const uint8_t * p = rgba + 4 * i;
+            y[i] = (uint8_t)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        }
+        for (size_t cy = 0; cy < ch; cy++) {
+            for (size_t cx = 0; cx < cw; cx++) {
+                int r = 0, g = 0, b = 0;
+                for (size_t dy = 0; dy < 2; dy++) {
+                    for (size_t dx = 0; dx < 2; dx++) {
+                        size_t x = std::min(2 * cx + dx, m_width - 1), yy = std::min(2 * cy + dy, m_height - 1);
+                        const uint8_t * p = rgba + 4 * (yy * m_width + x);
+                        r += p[0];
+                        g += p[1];
+                        b += p[2];
+                    }
+                }
+                u[cy * cw + cx] = (uint8_t)std::min((-43 * r - 85 * g + 128 * b + 4 * 32768 + 512) >> 10, 255);
+                v[cy * cw + cx] = (uint8_t)std::min((128 * r - 107 * g - 21 * b + 4 * 32768 + 512) >> 10, 255);
+            }
+        }
+    }
+
+    void writeFrame(const std::vector<uint8_t> & frame)
+    {
+        if (m_failed)
+            return;
+        bool ok;
+        if (m_y4m) {
+            toYuv420(frame.data());
+            ok = fputs("FRAME\n", m_out) >= 0 && fwrite(m_yuv.data(), 1, m_yuv.size(), m_out) == m_yuv.size();
+        } else {
+            ok = fwrite(frame.data(), 1, m_frameBytes, m_out) == m_frameBytes;
+        }
+        if (ok) {
+            m_written++;
+        } else {
+            std::cerr << "Error writing video; recording stopped" << std::endl;
+            m_failed = true;
+        }
+    }
+
+    void writerLoop()
+    {
+        while (true) {
+            std::vector<uint8_t> * frame = m_frames.front();
+            if (frame) {
+                writeFrame(*frame);
+                m_frames.pop();
+            } else if (m_stop) {
+                if (!m_frames.front())
+                    break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    }
+
+public:
+    VideoRecorder(const std::string & filename, size_t width, size_t height, size_t frameRate, size_t bufferedFrames = 16)
+        : m_width(width)
+        , m_height(height)
+        , m_frameBytes(width * height * 4)
+        , m_frames(bufferedFrames)
+    {
+        m_y4m = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".y4m") == 0;
+        if (m_y4m) {
+            m_out = fopen(filename.c_str(), "wb");
+            if (m_out) {
+                fprintf(m_out, "YUV4MPEG2 W%zu H%zu F%zu:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+                m_yuv.resize(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+            }
+        } else {
+            // A failed ffmpeg must end the recording, not the simulation.
+            signal(SIGPIPE, SIG_IGN);
+            std::string command = "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgba -s " + std::to_string(width) + "x" + std::to_string(height)
+                + " -r " + std::to_string(frameRate) + " -i - -vf 'pad=ceil(iw/2)*2:ceil(ih/2)*2' -pix_fmt yuv420p " + Quote(filename);
+            m_out = popen(command.c_str(), "w");
+            m_pipe = true;
+        }
+        if (!m_out) {
+            std::cerr << "Error opening video output: " << filename << std::endl;
+            return;
+        }
+
+        for (size_t i = 0; i < m_frames.capacity(); i++) {
+            std::vector<uint8_t> * slot = m_frames.beginPush();
+            slot->resize(m_frameBytes);
+            m_frames.endPush();
+            m_frames.pop();
+        }
+        m_thread = std::thread(&VideoRecorder::writerLoop, this);
+    }
+
+    // Write out the frames queued, then close the file or wait for ffmpeg to finish.
+    ~VideoRecorder()
+    {
+        if (m_thread.joinable()) {
+            m_stop = true;
+            m_thread.join();
+        }
+        if (m_out) {
+            if (m_pipe)
+                pclose(m_out);
+            else
+                fclose(m_out);
+        }
+        if (m_dropped > 0)
+            std::cerr << "Video: " << m_written << " frames written, " << m_dropped << " dropped" << std::endl;
+    }
+
+    VideoRecorder(const VideoRecorder &) = delete;
+    VideoRecorder & operator=(const VideoRecorder &) = delete;
+
+    size_t width() const
+    {
+        return m_width;
+    }
+
+    size_t height() const
+    {
+        return m_height;
+    }
+
+    /**
+     * The buffer to copy the next frame into, width * height RGBA pixels with rows top
+     * first, or null if the frame is to be dropped.  Call endFrame() once it is filled.
+     */
+    uint8_t * beginFrame()
+    {
+        std::vector<uint8_t> * slot = m_thread.joinable() ? m_frames.beginPush() : nullptr;
+        if (!slot) {
+            m_dropped++;
+            return nullptr;
+        }
+        return slot->data();
+    }
+
+    void endFrame()
+    {
+        m_frames.endPush();
+    }
+};
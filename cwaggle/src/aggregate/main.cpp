@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// For opendir and stat
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "TaskGraph.hpp"
+#include "../lasso/LogReader.hpp"
+
+using namespace std;
+
+/**
+ * Summarises a tree of results written by cwaggle_lasso (or by the live robots), such as
+ * data_from_paper/.  Every directory holding <STREAM>_<trial>.dat files is a condition.
+ * The files are parsed in parallel (memory-mapped, see LogReader), and each condition gets
+ *
+ *   <condition>/aggregate_<STREAM>.dat
+ *
+ * with a line per row of the files: the row, the number of trials that reached it, then
+ * for every column its mean, standard deviation and a bootstrap confidence interval of
+ * the mean.  Trials of unequal length, as from the live robots, are aligned by row and
+ * each row is summarised over the trials that have it.  A line per condition, with the
+ * second column (e.g. eval) at the last row that every trial reached, goes to stdout.
+ *
+ *   cwaggle_aggregate [-s STREAM] [-b RESAMPLES] [-c LEVEL] [-j THREADS] ROOT
+ *
+ * The defaults are "stats", 1000 resamples, a 0.95 interval and a thread per core.
+ */
+struct Options
+{
+    string stream = "stats";
+    size_t resamples = 1000;
+    double level = 0.95;
+    size_t threads = max(1u, thread::hardware_concurrency());
+};
+
+struct Condition
+{
+    string dir;
+    vector<string> files;
+    vector<unique_ptr<LogReader>> trials;
+    vector<string> summary;     // the line printed for this condition
+};
+
+// True if 'name' is <stream>_<digits>.dat.
+bool isTrialFile(const string & name, const string & stream)
+{
+    string prefix = stream + "_";
+    if (name.size() <= prefix.size() + 4 || name.compare(0, prefix.size(), prefix) != 0
+        || name.compare(name.size() - 4, 4, ".dat") != 0)
+        return false;
+    for (size_t i = prefix.size(); i < name.size() - 4; i++)
+        if (!isdigit((unsigned char)name[i]))
+            return false;
+    return true;
+}
+
+void scan(const string & dir, const string & stream, vector<Condition> & conditions)
+{
+    DIR * d = opendir(dir.c_str());
+    if (!d) {
+        cerr << "Cannot read directory " << dir << ": " << strerror(errno) << endl;
+        return;
+    }
+
+    Condition condition;
+    condition.dir = dir;
+    vector<string> subdirs;
+    while (dirent * entry = readdir(d)) {
+        string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            subdirs.push_back(path);
+        else if (isTrialFile(name, stream))
+            condition.files.push_back(path);
+    }
+    closedir(d);
+
+    if (!condition.files.empty()) {
+        // Trial order, so that the output does not depend on the directory order.
+        sort(condition.files.begin(), condition.files.end(), [&](const string & a, const string & b) {
+            size_t ia = atol(a.c_str() + a.rfind('_') + 1), ib = atol(b.c_str() + b.rfind('_') + 1);
+            return ia < ib;
+        });
+        conditions.push_back(move(condition));
+    }
+    sort(subdirs.begin(), subdirs.end());
+    for (auto & subdir : subdirs)
+        scan(subdir, stream, conditions);
+}
+
+/**
+ * The percentile bootstrap interval of the mean of 'values'.  The generator is seeded
+ * from the condition and row, so the output does not depend on the scheduling.
+ */
+void bootstrap(const vector<double> & values, size_t resamples, double level, uint64_t seed, double & lo, double & hi)
+{
+    size_t n = values.size();
+    if (n < 2 || resamples == 0) {
+        lo = hi = n > 0 ? values[0] : NAN;
+        return;
+    }
+
+    // splitmix64, and Lemire's multiply-shift to pick an index without division.
+    uint64_t state = seed;
+    auto next = [&state]() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    };
+
+    vector<double> means(resamples);
+    for (size_t b = 0; b < resamples; b++) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++)
+            sum += values[(size_t)(((unsigned __int128)(next() >> 32) * n) >> 32)];
+        means[b] = sum / n;
+    }
+    sort(means.begin(), means.end());
+    double tail = (1 - level) / 2;
+    lo = means[min(resamples - 1, (size_t)floor(tail * resamples))];
+    hi = means[min(resamples - 1, (size_t)floor((1 - tail) * resamples))];
+}
+
+// Column names for the stats stream (see DataLogger::write); other streams are numbered.
+string columnName(const string & stream, size_t c)
+{
+    static const vector<string> statsNames{ "step", "eval", "propSlowed", "cumPropSlowed", "avgTau", "avgMedianTau", "avgFilteredTau", "avgState" };
+    if (stream == "stats" && c < statsNames.size())
+        return statsNames[c];
+    return "c" + to_string(c);
+}
+
+void summarise(Condition & condition, const Options & options)
+{
+    size_t rows = 0, commonRows = SIZE_MAX, columns = 0;
+    for (auto & trial : condition.trials) {
+        rows = max(rows, trial->numRows());
+        commonRows = min(commonRows, trial->numRows());
+        columns = max(columns, trial->getColumns().size());
+    }
+
+    string filename = condition.dir + "/aggregate_" + options.stream + ".dat";
+    ofstream fout(filename);
+    fout << "row n";
+    for (size_t c = 0; c < columns; c++) {
+        string name = columnName(options.stream, c);
+        fout << " " << name << "_mean " << name << "_std " << name << "_lo " << name << "_hi";
+    }
+    fout << "\n";
+
+    uint64_t seed = 14695981039346656037ULL;
+    for (unsigned char ch : condition.dir)
+        seed = (seed ^ ch) * 1099511628211ULL;
+
+    vector<double> values;
+    ostringstream summary;
+    for (size_t r = 0; r < rows; r++) {
+        size_t present = 0;
+        for (auto & trial : condition.trials)
+            present += trial->numRows() > r;
+        fout << r << " " << present;
+
+        for (size_t c = 0; c < columns; c++) {
+            values.clear();
+            for (auto & trial : condition.trials) {
+                if (trial->numRows() > r && c < trial->getColumns().size()) {
+                    double v = trial->getColumns()[c][r];
+                    if (!std::isnan(v))
+                        values.push_back(v);
+                }
+            }
+
+            double mean = 0, var = 0;
+            for (double v : values)
+                mean += v;
+            mean = values.empty() ? NAN : mean / values.size();
+            for (double v : values)
+                var += (v - mean) * (v - mean);
+            double sd = values.size() > 1 ? sqrt(var / (values.size() - 1)) : 0;
+
+            // Every resample of constant values (such as the step) has the same mean.
+            double lo = mean, hi = mean;
+            if (sd > 0)
+                bootstrap(values, options.resamples, options.level, seed ^ (r * 0x100000001b3ULL + c), lo, hi);
+            fout << " " << mean << " " << sd << " " << lo << " " << hi;
+
+            if (c == min<size_t>(1, columns - 1) && r + 1 == commonRows)
+                summary << condition.dir << "\t" << condition.trials.size() << " trials\t" << columnName(options.stream, c)
+                        << " at row " << r << ": " << mean << " [" << lo << ", " << hi << "]";
+        }
+        fout << "\n";
+    }
+    if (!fout)
+        cerr << "Error writing " << filename << endl;
+    condition.summary.push_back(summary.str());
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    string root;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-s" && i + 1 < argc)
+            options.stream = argv[++i];
+        else if (arg == "-b" && i + 1 < argc)
+            options.resamples = atol(argv[++i]);
+        else if (arg == "-c" && i + 1 < argc)
+            options.level = atof(argv[++i]);
+        else if (arg == "-j" && i + 1 < argc)
+            options.threads = max(1L, atol(argv[++i]));
+        else if (root.empty() && arg[0] != '-')
+            root = arg;
+        else
+            root.clear(), i = argc;
+    }
+    if (root.empty() || options.level <= 0 || options.level >= 1) {
+        cerr << "Usage\n\tcwaggle_aggregate [-s STREAM] [-b RESAMPLES] [-c LEVEL] [-j THREADS] ROOT" << endl;
+        return -1;
+    }
+
+    vector<Condition> conditions;
+    scan(root, options.stream, conditions);
+    if (conditions.empty()) {
+        cerr << "No " << options.stream << "_<trial>.dat files under " << root << endl;
+        return 1;
+    }
+
+    // A node per file to parse, and one per condition to summarise once its files are in.
+    TaskGraph graph;
+    for (auto & condition : conditions) {
+        condition.trials.resize(condition.files.size());
+        vector<size_t> parseNodes;
+        for (size_t t = 0; t < condition.files.size(); t++) {
+            parseNodes.push_back(graph.add("parse", [&condition, t] {
+                condition.trials[t] = make_unique<LogReader>(condition.files[t]);
+                if (!condition.trials[t]->good())
+                    cerr << "Error reading " << condition.files[t] << ": " << condition.trials[t]->getError() << endl;
+            }));
+        }
+        graph.add("summarise", [&condition, &options] { summarise(condition, options); }, parseNodes);
+    }
+    WorkStealingPool pool(options.threads);
+    graph.run(&pool);
+
+    for (auto & condition : conditions)
+        for (auto & line : condition.summary)
+            cout << line << "\n";
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../lasso/LogReader.hpp"
+
+using namespace std;
+
+namespace py = pybind11;
+
+// The numpy type of a column: little-endian for the mapped binary logs (numpy converts on
+// access if the host is not), native doubles for text logs.
+static py::dtype columnDtype(const ColumnView & column)
+{
+    if (!column.mapped)
+        return py::dtype::of<double>();
+    switch (column.type) {
+    case BinaryLogWriter::INT32: return py::dtype::from_args(py::str("<i4"));
+    case BinaryLogWriter::INT64: return py::dtype::from_args(py::str("<i8"));
+    default: return py::dtype::from_args(py::str("<f8"));
+    }
+}
+
+// A read-only array over one segment, keeping 'owner' (the LogFile) alive while it exists.
+static py::array segmentArray(const ColumnView & column, const ColumnView::Segment & segment, py::handle owner)
+{
+    py::ssize_t width = BinaryLogWriter::typeWidth(column.type);
+    py::array array(columnDtype(column), { (py::ssize_t)segment.rows }, { width }, segment.data, owner);
+    array.attr("setflags")(py::arg("write") = false);
+    return array;
+}
+
+static const ColumnView & findColumn(const LogReader & reader, py::handle key)
+{
+    if (py::isinstance<py::int_>(key)) {
+        py::ssize_t index = key.cast<py::ssize_t>();
+        if (index < 0)
+            index += reader.getColumns().size();
+        if (index < 0 || index >= (py::ssize_t)reader.getColumns().size())
+            throw py::index_error("column index out of range");
+        return reader.getColumns()[index];
+    }
+    const ColumnView * column = reader.getColumn(key.cast<string>());
+    if (!column)
+        throw py::key_error(key.cast<string>());
+    return *column;
+}
+
+/**
+ * A column as one array.  This is a view of the file (or of the parsed text) when the
+ * column is contiguous; a binary log of several chunks is joined into a new array.
+ */
+static py::array columnArray(py::object self, py::handle key)
+{
+    const LogReader & reader = self.cast<const LogReader &>();
+    const ColumnView & column = findColumn(reader, key);
+    if (column.contiguous()) {
+        ColumnView::Segment segment = column.segments.empty() ? ColumnView::Segment{ nullptr, 0 } : column.segments[0];
+        return segmentArray(column, segment, self);
+    }
+
+    size_t width = BinaryLogWriter::typeWidth(column.type);
+    py::array joined(columnDtype(column), { (py::ssize_t)column.rows });
+    uint8_t * out = (uint8_t *)joined.mutable_data();
+    for (auto & segment : column.segments) {
+        memcpy(out, segment.data, segment.rows * width);
+        out += segment.rows * width;
+    }
+    return joined;
+}
+
+PYBIND11_MODULE(cwaggle_logreader, m) {
+    m.doc() = "Reads cwaggle_lasso logs (binary or text) into numpy arrays, memory-mapped.";
+
+    py::class_<LogReader, shared_ptr<LogReader>>(m, "LogFile")
+        .def(py::init([](const string & filename) {
+            auto reader = make_shared<LogReader>(filename);
+            if (!reader->good())
+                throw py::value_error(filename + ": " + reader->getError());
+            return reader;
+        }), py::arg("filename"))
+        .def_property_readonly("filename", &LogReader::getFilename)
+        .def_property_readonly("binary", &LogReader::isBinary)
+        .def_property_readonly("columns", [](const LogReader & reader) {
+            vector<string> names;
+            for (auto & column : reader.getColumns())
+                names.push_back(column.name);
+            return names;
+        })
+        .def("__len__", &LogReader::numRows)
+        .def("__getitem__", &columnArray, "A column by name or index, as a read-only array.")
+        .def("__contains__", [](const LogReader & reader, const string & name) {
+            return reader.getColumn(name) != nullptr;
+        })
+        .def("chunks", [](py::object self, py::handle key) {
+            const ColumnView & column = findColumn(self.cast<const LogReader &>(), key);
+            py::list arrays;
+            for (auto & segment : column.segments)
+                arrays.append(segmentArray(column, segment, self));
+            return arrays;
+        }, "A column as a list of read-only arrays, one per chunk, none of them copied.")
+        .def("to_dict", [](py::object self) {
+            py::dict columns;
+            for (auto & column : self.cast<const LogReader &>().getColumns())
+                columns[py::str(column.name)] = columnArray(self, py::str(column.name));
+            return columns;
+        }, "All the columns, by name.");
+}
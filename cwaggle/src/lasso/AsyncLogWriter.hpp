@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "SpscRing.hpp"
+
+#include "DataLogger.hpp"
+
+using namespace std;
+
+/**
+ * Moves log output off the simulation thread.  The simulation captures each logged step
+ * straight into a preallocated slot of a lock-free ring, and a writer thread formats the
+ * records and writes them through the DataLogger, flushing only once it has caught up.
+ *
+ * The ring holds at most 'capacity' records.  When it is full the simulation either waits
+ * for the writer ("stall", which loses nothing) or skips the record ("drop", which never
+ * waits); either way it never waits on I/O itself.
+ */
+class AsyncLogWriter
+{
+    DataLogger & m_logger;
+    SpscRing<DataLogger::LogRecord> m_ring;
+    bool m_dropWhenFull;
+    size_t m_dropped = 0;
+    size_t m_stalls = 0;
+    atomic<bool> m_stop{ false };
+    thread m_thread;
+
+    void writerLoop()
+    {
+        while (true) {
+            DataLogger::LogRecord * record = m_ring.front();
+            if (record) {
+                m_logger.write(*record, m_ring.size() == 1);
+                m_ring.pop();
+            } else if (m_stop) {
+                // Anything pushed before the stop request is visible by now.
+                if (!m_ring.front())
+                    break;
+            } else {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+    }
+
+public:
+    AsyncLogWriter(DataLogger & logger, size_t capacity, bool dropWhenFull)
+        : m_logger(logger)
+        , m_ring(capacity)
+        , m_dropWhenFull(dropWhenFull)
+    {
+        m_thread = thread(&AsyncLogWriter::writerLoop, this);
+    }
+
+    // Write out everything queued, then stop the writer thread.
+    ~AsyncLogWriter()
+    {
+        m_stop = true;
+        m_thread.join();
+        if (m_dropped > 0 || m_stalls > 0)
+            cerr << "Log writer: " << m_dropped << " records dropped, " << m_stalls << " stalls" << endl;
+    }
+
+    /**
+     * The record to fill for the next logged step, or null if it is to be dropped.  Call
+     * endRecord() once the record is filled in.
+     */
+    DataLogger::LogRecord * beginRecord()
+    {
+        DataLogger::LogRecord * record = m_ring.beginPush();
+        if (record || m_dropWhenFull) {
+            m_dropped += record ? 0 : 1;
+            return record;
+        }
+
+        m_stalls++;
+        while ((record = m_ring.beginPush()) == nullptr)
+            this_thread::yield();
+        return record;
+    }
+
+    void endRecord()
+    {
+        m_ring.endPush();
+    }
+};
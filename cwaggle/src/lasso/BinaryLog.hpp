@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A binary columnar log: a typed schema header followed by chunks of rows, with each chunk
+ * storing its columns one after another.  Every value is fixed-width and little-endian
+ * regardless of the host, so a column of a chunk can be read as a plain array.
+ *
+ *   header:  "CWLOG\0\0\0"  uint32 version  uint32 numColumns
+ *            per column: uint8 type  uint16 nameLength  name
+ *   chunk:   uint32 numRows
+ *            per column: numRows values of the column's type
+ *
+ * A reader for Python is in analysis_scripts/binlog.py.
+ */
+class BinaryLogWriter
+{
+public:
+    enum ColumnType : uint8_t { INT32 = 1, INT64 = 2, FLOAT64 = 3 };
+
+    struct Column
+    {
+        string name;
+        ColumnType type;
+    };
+
+    static const uint32_t Version = 1;
+
+    static size_t typeWidth(ColumnType type)
+    {
+        return type == INT32 ? 4 : 8;
+    }
+
+private:
+    ostream m_out;
+    vector<Column> m_columns;
+    vector<vector<uint8_t>> m_chunk;
+    size_t m_chunkRows;
+    size_t m_rows = 0;
+
+    static void putLE(vector<uint8_t> & out, uint64_t value, size_t width)
+    {
+        for (size_t i = 0; i < width; i++)
+            out.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+public:
+    // Write to the given buffer (a file, or memory for a SweepArchive), which must outlive this.
+    BinaryLogWriter(streambuf * buffer, size_t chunkRows)
+        : m_out(buffer)
+        , m_chunkRows(chunkRows > 0 ? chunkRows : 1)
+    {
+    }
+
+    ~BinaryLogWriter()
+    {
+        flush();
+    }
+
+    bool hasSchema() const
+    {
+        return !m_columns.empty();
+    }
+
+    const vector<Column> & getColumns() const
+    {
+        return m_columns;
+    }
+
+    // Write the header.  This must be called once, before the first row.
+    void setSchema(const vector<Column> & columns)
+    {
+        m_columns = columns;
+        m_chunk.assign(columns.size(), vector<uint8_t>());
+
+        vector<uint8_t> header{ 'C', 'W', 'L', 'O', 'G', 0, 0, 0 };
+        putLE(header, Version, 4);
+        putLE(header, columns.size(), 4);
+        for (auto & column : columns) {
+            putLE(header, column.type, 1);
+            putLE(header, column.name.size(), 2);
+            header.insert(header.end(), column.name.begin(), column.name.end());
+        }
+        m_out.write((const char *)header.data(), header.size());
+    }
+
+    // Append a row, given one value per column in schema order.
+    void appendRow(const vector<double> & values)
+    {
+        for (size_t c = 0; c < m_columns.size(); c++) {
+            double value = c < values.size() ? values[c] : 0;
+            switch (m_columns[c].type) {
+            case INT32: putLE(m_chunk[c], (uint32_t)(int32_t)value, 4); break;
+            case INT64: putLE(m_chunk[c], (uint64_t)(int64_t)value, 8); break;
+            case FLOAT64: {
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                putLE(m_chunk[c], bits, 8);
+                break;
+            }
+            }
+        }
+        if (++m_rows == m_chunkRows)
+            flush();
+    }
+
+    // Write out the rows appended so far as a chunk.
+    void flush()
+    {
+        if (m_rows == 0)
+            return;
+
+        vector<uint8_t> count;
+        putLE(count, m_rows, 4);
+        m_out.write((const char *)count.data(), count.size());
+        for (auto & column : m_chunk) {
+            m_out.write((const char *)column.data(), column.size());
+            column.clear();
+        }
+        m_out.flush();
+        m_rows = 0;
+    }
+};
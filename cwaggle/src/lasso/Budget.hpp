@@ -0,0 +1,73 @@
+#pragma once
+
+#include <csignal>
+#include <cstddef>
+
+#include "Timer.hpp"
+
+using namespace std;
+
+// The signal which asked us to stop (SIGTERM or SIGINT), or 0.
+volatile sig_atomic_t g_stopSignal = 0;
+
+void HandleStopSignal(int signum)
+{
+    g_stopSignal = signum;
+}
+
+/**
+ * Make SIGTERM and SIGINT request a graceful stop rather than kill the process, so that the
+ * running trial can end early, its logs get closed and the sweep manifest is written.  The
+ * handler is installed without SA_RESTART so that blocking calls such as accept() return.
+ */
+void InstallStopHandlers()
+{
+    struct sigaction action = {};
+    action.sa_handler = HandleStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+}
+
+bool StopRequested()
+{
+    return g_stopSignal != 0;
+}
+
+/**
+ * A limit on wall-clock time and/or simulated steps.  A limit of 0 means unlimited.  Steps
+ * are counted once each trial finishes; exhausted() takes the steps of a trial in
+ * progress so that a trial can be cut short as soon as the budget runs out.
+ */
+class RunBudget
+{
+    double m_seconds;
+    size_t m_steps;
+    size_t m_stepsUsed = 0;
+    Timer m_timer;
+
+public:
+    RunBudget(double seconds = 0, size_t steps = 0)
+        : m_seconds(seconds)
+        , m_steps(steps)
+    {
+    }
+
+    void addSteps(size_t steps)
+    {
+        m_stepsUsed += steps;
+    }
+
+    bool exhausted(size_t pendingSteps = 0)
+    {
+        if (m_steps > 0 && m_stepsUsed + pendingSteps >= m_steps)
+            return true;
+        return m_seconds > 0 && m_timer.getElapsedTimeInSec() >= m_seconds;
+    }
+
+    // True once the budget is spent or a stop signal has arrived.
+    bool shouldStop(size_t pendingSteps = 0)
+    {
+        return StopRequested() || exhausted(pendingSteps);
+    }
+};
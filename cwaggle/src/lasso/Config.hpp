@@ -3,10 +3,13 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <type_traits>
 
 struct Config
 {
     size_t gui          = 1;
+    size_t renderThread = 0;            // draw the GUI on its own thread
     size_t numRobots    = 20;
     size_t fakeRobots    = 0;
     double robotRadius  = 10.0;
@@ -28,11 +31,48 @@ struct Config
 
     size_t writeDataSkip    = 0;
     std::string dataFilenameBase   = "";
+    std::string logFormat   = "text";       // "text" or "binary" (see BinaryLog.hpp)
+    size_t logChunkRows     = 1024;         // rows per chunk of a binary log
+    size_t stateEvents      = 0;            // log controller state changes to stateEvents_<trial>.dat
+    size_t aggregateSkip    = 0;            // steps between rows of summary.dat, 0 for none
+    size_t heatmapSkip      = 0;            // steps between heatmap samples, 0 for none (see Heatmap.hpp)
+    double heatmapCellSize  = 10;           // the side of a heatmap cell, in world units
+    double heatmapHalfLife  = 10000;        // steps over which a sample's weight in the decayed maps halves
+    size_t replayDigestSkip = 0;            // steps between state digests in replay_<trial>.txt, 0 for none
+    std::string archiveFile = "";           // append all logs to this SweepArchive instead
+    size_t logQueueSize     = 0;            // records queued for the writer thread, 0 for none
+    std::string logQueuePolicy = "stall";   // when the queue is full: "stall" or "drop"
+
+    // Per-stream rates and capture windows (see LogSchedule.hpp).  A skip of 0 is writeDataSkip.
+    size_t statsSkip        = 0;
+    size_t robotPoseSkip    = 0;
+    size_t robotStateSkip   = 0;
+    size_t puckPositionSkip = 0;
+    double puckMovedThreshold = 0;          // write puckPosition only once a puck moved this far, 0 for always
+    std::string captureTriggers = "";       // comma-separated: stateChange, nan, wallCollision
+    size_t captureBefore    = 0;            // steps captured before a trigger
+    size_t captureAfter     = 0;            // steps captured after a trigger
+    size_t captureSkip      = 1;            // steps between records in a capture window
+    size_t flightRecorderSteps = 0;         // steps of full state kept for a dump on failure (see FlightRecorder.hpp)
+
+    // Live telemetry datagrams (see LiveTelemetry.hpp).  Empty socket path to disable.
+    std::string liveTelemetrySocket = "";
+    size_t liveTelemetrySkip = 10;          // steps between messages
+    size_t livePoseSkip      = 0;           // steps between messages with poses, 0 for none
+
+    // Write robotPose and puckPosition as compressed .trj streams (see TrajectoryCodec.hpp).
+    size_t trajectoryCompression  = 0;
+    double trajectoryQuantum      = 0.01;   // position resolution
+    double trajectoryAngleQuantum = 0.001;  // angle resolution (radians)
+    size_t trajectoryKeyframes    = 100;    // frames between keyframes
     size_t numTrials = 10;
     std::string evalName = "";
 
     size_t captureScreenshots          = 0;
     std::string screenshotFilenameBase   = "";
+    std::string videoFilenameBase = "";     // record each trial's GUI to <base><trial>.<videoFormat>
+    std::string videoFormat       = "mp4";  // y4m is written directly, anything else by ffmpeg
+    size_t videoFrameRate         = 96;
 
     double maxForwardSpeed = 2;
     double maxAngularSpeed = 0.05; // 2.0; // 0.5
@@ -50,6 +90,30 @@ struct Config
     size_t arenaSweep         = 0;
     size_t paramSweep         = 0;
 
+    // Directory holding cached trial results (see ResultCache.hpp).  Empty to disable.
+    std::string resultCacheDir = "";
+
+    // Parameter optimisation (see Optimiser.hpp).
+    std::string optimParams = "";
+    std::string optimMethod = "cmaes";
+    size_t optimEvaluations = 64;
+    size_t optimBatchSize = 8;
+    size_t optimWorkers = 4;
+    size_t optimSeeds = 0;
+    size_t optimRejectAfter = 3;
+    double optimRejectFactor = 1.5;
+
+    // Budgets (see Budget.hpp), 0 for unlimited.  A trial over trialTimeBudget seconds is
+    // cut short but still counts; once a sweep budget runs out, the running trial is
+    // interrupted and no more are started.
+    double trialTimeBudget = 0;
+    double sweepTimeBudget = 0;
+    size_t sweepStepBudget = 0;
+
+    // Record completed trials in <dataFilenameBase>/manifest.txt and skip them when the
+    // same sweep is run again (see SweepManifest.hpp).
+    size_t sweepManifest = 0;
+
     Config() {}
 
     Config(const std::string & filename) {
@@ -64,41 +128,160 @@ struct Config
         std::string token;
         double tempVal = 0;
  
-        while (fin.good())
-        {
-            fin >> token;
-            if (token == "numRobots")      { fin >> numRobots; }
-            else if (token == "fakeRobots")    { fin >> fakeRobots; }
-            else if (token == "robotRadius")    { fin >> robotRadius; }
-            else if (token == "plowLength")    { fin >> plowLength; }
-            else if (token == "plowAngleDeg")    { fin >> plowAngleDeg; }
-            else if (token == "gui")            { fin >> gui; }
-            else if (token == "numPucks")       { fin >> numPucks; }
-            else if (token == "puckRadius")     { fin >> puckRadius; }
-            else if (token == "arenaConfig")       { fin >> arenaConfig; }
-            else if (token == "controllerSkip")     { fin >> controllerSkip; }
-            else if (token == "simTimeStep")    { fin >> simTimeStep; }
-            else if (token == "renderSteps")     { fin >> renderSteps; }
-            else if (token == "maxTimeSteps")   { fin >> maxTimeSteps; }
-            else if (token == "writeDataSkip")  { fin >> writeDataSkip; }
-            else if (token == "dataFilenameBase")   { fin >> dataFilenameBase; }
-            else if (token == "numTrials")   { fin >> numTrials; }
-            else if (token == "evalName")   { fin >> evalName; }
-            else if (token == "captureScreenshots")   { fin >> captureScreenshots; }
-            else if (token == "screenshotFilenameBase")   { fin >> screenshotFilenameBase; }
-            else if (token == "maxForwardSpeed")             { fin >> maxForwardSpeed; }
-            else if (token == "maxAngularSpeed")        { fin >> maxAngularSpeed; }
-            else if (token == "robotSensingDistance")   { fin >> robotSensingDistance; }
-            else if (token == "puckSensingDistance")    { fin >> puckSensingDistance; }
-            else if (token == "goalX")     { fin >> goalX; }
-            else if (token == "goalY")     { fin >> goalY; }
-            else if (token == "sensorNoise")     { fin >> sensorNoise; }
-            else if (token == "controllerState")     { fin >> controllerState; }
-            else if (token == "filterConstant")     { fin >> filterConstant; }
-            else if (token == "controllerBlindness")     { fin >> controllerBlindness; }
-            else if (token == "escapeDuration")     { fin >> escapeDuration; }
-            else if (token == "arenaSweep")     { fin >> arenaSweep; }
-            else if (token == "paramSweep")     { fin >> paramSweep; }
-        }
+        while (fin >> token)
+            set(token, fin);
+    }
+
+    /**
+     * Call visitor(name, value) for every parameter.  This is the single list of parameters
+     * that loading, saving and hashing a configuration are all built on.
+     */
+    template <typename Visitor>
+    void visit(Visitor && visitor)
+    {
+        visitor("numRobots", numRobots);
+        visitor("fakeRobots", fakeRobots);
+        visitor("robotRadius", robotRadius);
+        visitor("plowLength", plowLength);
+        visitor("plowAngleDeg", plowAngleDeg);
+        visitor("gui", gui);
+        visitor("renderThread", renderThread);
+        visitor("numPucks", numPucks);
+        visitor("puckRadius", puckRadius);
+        visitor("arenaConfig", arenaConfig);
+        visitor("controllerSkip", controllerSkip);
+        visitor("simTimeStep", simTimeStep);
+        visitor("renderSteps", renderSteps);
+        visitor("maxTimeSteps", maxTimeSteps);
+        visitor("writeDataSkip", writeDataSkip);
+        visitor("dataFilenameBase", dataFilenameBase);
+        visitor("logFormat", logFormat);
+        visitor("logChunkRows", logChunkRows);
+        visitor("stateEvents", stateEvents);
+        visitor("aggregateSkip", aggregateSkip);
+        visitor("heatmapSkip", heatmapSkip);
+        visitor("heatmapCellSize", heatmapCellSize);
+        visitor("heatmapHalfLife", heatmapHalfLife);
+        visitor("replayDigestSkip", replayDigestSkip);
+        visitor("archiveFile", archiveFile);
+        visitor("logQueueSize", logQueueSize);
+        visitor("logQueuePolicy", logQueuePolicy);
+        visitor("statsSkip", statsSkip);
+        visitor("robotPoseSkip", robotPoseSkip);
+        visitor("robotStateSkip", robotStateSkip);
+        visitor("puckPositionSkip", puckPositionSkip);
+        visitor("puckMovedThreshold", puckMovedThreshold);
+        visitor("captureTriggers", captureTriggers);
+        visitor("captureBefore", captureBefore);
+        visitor("captureAfter", captureAfter);
+        visitor("captureSkip", captureSkip);
+        visitor("flightRecorderSteps", flightRecorderSteps);
+        visitor("liveTelemetrySocket", liveTelemetrySocket);
+        visitor("liveTelemetrySkip", liveTelemetrySkip);
+        visitor("livePoseSkip", livePoseSkip);
+        visitor("trajectoryCompression", trajectoryCompression);
+        visitor("trajectoryQuantum", trajectoryQuantum);
+        visitor("trajectoryAngleQuantum", trajectoryAngleQuantum);
+        visitor("trajectoryKeyframes", trajectoryKeyframes);
+        visitor("numTrials", numTrials);
+        visitor("evalName", evalName);
+        visitor("captureScreenshots", captureScreenshots);
+        visitor("screenshotFilenameBase", screenshotFilenameBase);
+        visitor("videoFilenameBase", videoFilenameBase);
+        visitor("videoFormat", videoFormat);
+        visitor("videoFrameRate", videoFrameRate);
+        visitor("maxForwardSpeed", maxForwardSpeed);
+        visitor("maxAngularSpeed", maxAngularSpeed);
+        visitor("robotSensingDistance", robotSensingDistance);
+        visitor("puckSensingDistance", puckSensingDistance);
+        visitor("goalX", goalX);
+        visitor("goalY", goalY);
+        visitor("sensorNoise", sensorNoise);
+        visitor("controllerState", controllerState);
+        visitor("filterConstant", filterConstant);
+        visitor("controllerBlindness", controllerBlindness);
+        visitor("escapeDuration", escapeDuration);
+        visitor("arenaSweep", arenaSweep);
+        visitor("paramSweep", paramSweep);
+        visitor("resultCacheDir", resultCacheDir);
+        visitor("optimParams", optimParams);
+        visitor("optimMethod", optimMethod);
+        visitor("optimEvaluations", optimEvaluations);
+        visitor("optimBatchSize", optimBatchSize);
+        visitor("optimWorkers", optimWorkers);
+        visitor("optimSeeds", optimSeeds);
+        visitor("optimRejectAfter", optimRejectAfter);
+        visitor("optimRejectFactor", optimRejectFactor);
+        visitor("trialTimeBudget", trialTimeBudget);
+        visitor("sweepTimeBudget", sweepTimeBudget);
+        visitor("sweepStepBudget", sweepStepBudget);
+        visitor("sweepManifest", sweepManifest);
+    }
+
+    /**
+     * Read the value of the parameter named 'token' from the given stream.  Returns false
+     * if no such parameter exists.
+     */
+    bool set(const std::string & token, std::istream & in)
+    {
+        bool found = false;
+        visit([&](const char * name, auto & value) {
+            if (!found && token == name) {
+                in >> value;
+                found = true;
+            }
+        });
+        return found;
+    }
+
+    /**
+     * Set the parameter named 'token' from the text of its value, which must be read whole:
+     * trailing characters, fractions for integer parameters and negative numbers for
+     * unsigned ones are errors.  Returns false, leaving the parameter unchanged, if there is
+     * no such parameter or the value is invalid.
+     */
+    bool set(const std::string & token, const std::string & value)
+    {
+        bool found = false, valid = false;
+        visit([&](const char * name, auto & field) {
+            if (!found && token == name) {
+                found = true;
+                valid = Parse(value, field);
+            }
+        });
+        return valid;
+    }
+
+    template <class T>
+    static bool Parse(const std::string & text, T & value)
+    {
+        std::istringstream in(text);
+        in >> std::ws;
+        if (std::is_unsigned<T>::value && in.peek() == '-')
+            return false;
+        T parsed;
+        in >> parsed;
+        if (in.fail())
+            return false;
+        in >> std::ws;
+        if (!in.eof())
+            return false;
+        value = parsed;
+        return true;
+    }
+
+    /**
+     * Write all parameters in the format read by load().  Empty strings are left out since
+     * they could not be read back.
+     */
+    void save(std::ostream & out)
+    {
+        visit([&out](const char * name, auto & value) {
+            std::ostringstream oss;
+            oss.precision(17);
+            oss << value;
+            if (!oss.str().empty())
+                out << name << " " << oss.str() << "\n";
+        });
     }
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <fstream>
+#include <sstream>
+#include <vector>
 #include <memory>
 #include <string>
 #include <iostream>
@@ -12,16 +14,87 @@
 #include "CWaggle.h"
 
 #include "Config.hpp"
-#include "LassoController.hpp"
+#include "Telemetry.hpp"
+#include "BinaryLog.hpp"
+#include "TrajectoryCodec.hpp"
+#include "SweepArchive.hpp"
 
 using namespace std;
 
 class DataLogger {
     Config m_config;
     int m_trialIndex;
-    ofstream m_statsStream, m_robotPoseStream, m_robotStateStream, m_puckPositionStream;
+
+    // Where each stream goes: a file, or a SweepArchive in segments of ArchiveSegmentBytes.
+    vector<pair<string, unique_ptr<streambuf>>> m_buffers;
+    static const size_t ArchiveSegmentBytes = 1 << 20;
+
+    ostream m_statsStream{ nullptr }, m_robotPoseStream{ nullptr }, m_robotStateStream{ nullptr }, m_puckPositionStream{ nullptr };
+    ostream m_stateEventStream{ nullptr };
+    unique_ptr<BinaryLogWriter> m_binaryLog;
+    vector<double> m_row;
+    unique_ptr<TrajectoryEncoder> m_robotPoseTrajectory, m_puckPositionTrajectory;
+
+    // The registry sampled by capture(), and the slots of the per-robot columns it averages.
+    const Telemetry * m_telemetry = nullptr;
+    vector<size_t> m_tauSlots, m_medianTauSlots, m_filteredTauSlots, m_stateSlots;
 
 public:
+    // The text streams a LogRecord goes to (see LogSchedule.hpp); the binary log takes any.
+    enum Stream : unsigned { STATS = 1, ROBOT_POSE = 2, ROBOT_STATE = 4, PUCK_POSITION = 8, ALL_STREAMS = 15 };
+
+    // True if config.logFormat selects the binary format (see BinaryLog.hpp).
+    static bool isBinary(const Config & config)
+    {
+        return config.logFormat == "binary";
+    }
+
+    // True if controller state changes are logged (see writeStateEvent).
+    static bool hasStateEvents(const Config & config)
+    {
+        return config.writeDataSkip && config.stateEvents;
+    }
+
+    // The names of the streams written for each trial.  The binary format has just one,
+    // plus the state events if they are logged.
+    static vector<string> getStreamNames(const Config & config)
+    {
+        vector<string> names;
+        if (isBinary(config))
+            names = { "log" };
+        else
+            names = { "stats", "robotPose", "robotState", "puckPosition" };
+        if (hasStateEvents(config))
+            names.push_back("stateEvents");
+        return names;
+    }
+
+    // True if the given text stream is written as a compressed trajectory (see TrajectoryCodec.hpp).
+    static bool isCompressed(const Config & config, const string & streamName)
+    {
+        return !isBinary(config) && config.trajectoryCompression && (streamName == "robotPose" || streamName == "puckPosition");
+    }
+
+    static string getExtension(const Config & config, const string & streamName)
+    {
+        if (streamName == "stateEvents")
+            return ".dat";
+        return isBinary(config) ? ".bin" : isCompressed(config, streamName) ? ".trj" : ".dat";
+    }
+
+    static string getFilename(const Config & config, const string & streamName, int trialIndex)
+    {
+        stringstream filename;
+        filename << config.dataFilenameBase << "/" << streamName << "_" << trialIndex << getExtension(config, streamName);
+        return filename.str();
+    }
+
+    // True if the logs are appended to config.archiveFile rather than written as files.
+    static bool isArchived(const Config & config)
+    {
+        return !config.archiveFile.empty();
+    }
+
     DataLogger(Config config, int trialIndex)
         : m_config(config)
         , m_trialIndex(trialIndex)
@@ -29,70 +102,283 @@ public:
         //cout << "rngSeed: " << rngSeed << endl;
         if (m_config.writeDataSkip) {
 
-            if (mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+            if (!isArchived(m_config) && mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
                 cerr << "Error creating directory: " << m_config.dataFilenameBase << endl;
 
-            stringstream statsFilename, robotPoseFilename, robotStateFilename, puckPositionFilename;
-            statsFilename << m_config.dataFilenameBase << "/stats_" << trialIndex << ".dat";
-            robotPoseFilename << m_config.dataFilenameBase << "/robotPose_" << trialIndex << ".dat";
-            robotStateFilename << m_config.dataFilenameBase << "/robotState_" << trialIndex << ".dat";
-            puckPositionFilename << m_config.dataFilenameBase << "/puckPosition_" << trialIndex << ".dat";
+            if (m_config.logFormat != "text" && !isBinary(m_config))
+                cerr << "Unknown logFormat '" << m_config.logFormat << "', writing text logs" << endl;
 
-            m_statsStream = ofstream(statsFilename.str());
-            m_robotPoseStream = ofstream(robotPoseFilename.str());
-            m_robotStateStream = ofstream(robotStateFilename.str());
-            m_puckPositionStream = ofstream(puckPositionFilename.str());
+            if (isBinary(m_config)) {
+                m_binaryLog = make_unique<BinaryLogWriter>(openBuffer("log"), m_config.logChunkRows);
+            } else {
+                m_statsStream.rdbuf(openBuffer("stats"));
+                m_robotPoseStream.rdbuf(openBuffer("robotPose"));
+                m_robotStateStream.rdbuf(openBuffer("robotState"));
+                m_puckPositionStream.rdbuf(openBuffer("puckPosition"));
+            }
+
+            if (hasStateEvents(m_config))
+                m_stateEventStream.rdbuf(openBuffer("stateEvents"));
         }
     }
 
-    void writeToFile(shared_ptr<World> world, double stepCount, double eval, double propSlowed, double cumPropSlowed)
+    ~DataLogger()
+    {
+        // The writers put out what they still hold before the buffers are closed.
+        m_binaryLog.reset();
+        m_robotPoseTrajectory.reset();
+        m_puckPositionTrajectory.reset();
+        for (auto & buffer : m_buffers)
+            buffer.second->pubsync();
+
+        if (isArchived(m_config)) {
+            for (auto & buffer : m_buffers)
+                static_cast<SweepArchive::SegmentBuffer &>(*buffer.second).close();
+        }
+    }
+
+    /**
+     * Sample the given registry in capture().  This must be called once its columns are all
+     * registered, as the binary schema and the averaged per-robot columns are taken from it.
+     */
+    void setTelemetry(const Telemetry & telemetry)
+    {
+        m_telemetry = &telemetry;
+        m_tauSlots = telemetry.getGroup("tau");
+        m_medianTauSlots = telemetry.getGroup("medianTau");
+        m_filteredTauSlots = telemetry.getGroup("filteredTau");
+        m_stateSlots = telemetry.getGroup("state");
+    }
+
+    // Open the given stream's file, or its segments in the archive.
+    streambuf * openBuffer(const string & streamName)
+    {
+        unique_ptr<streambuf> buffer;
+        if (isArchived(m_config)) {
+            buffer = make_unique<SweepArchive::SegmentBuffer>(m_config.archiveFile, m_config.dataFilenameBase, m_trialIndex,
+                streamName + getExtension(m_config, streamName), ArchiveSegmentBytes);
+        } else {
+            auto file = make_unique<filebuf>();
+            if (!file->open(getFilename(m_config, streamName, m_trialIndex), ios::out | ios::binary))
+                cerr << "Error opening " << getFilename(m_config, streamName, m_trialIndex) << endl;
+            buffer = move(file);
+        }
+        m_buffers.emplace_back(streamName, move(buffer));
+        return m_buffers.back().second.get();
+    }
+
+    /**
+     * Everything written for one logged step.  Capturing a record is cheap, and the record
+     * no longer refers to the world, so it can be formatted and written while the
+     * simulation carries on (see MyExperiment::doSimulationStep).
+     */
+    struct LogRecord
     {
+        double stepCount = 0, eval = 0, propSlowed = 0, cumPropSlowed = 0;
+        double avgTau = 0, avgMedianTau = 0, avgFilteredTau = 0, avgState = 0;
+        vector<Vec2> robotPos;
+        vector<double> robotAngle;
+        vector<int> robotState;
+        vector<Vec2> puckPos;
+        vector<double> telemetry;       // the registry's values, by slot
+        unsigned streams = ALL_STREAMS; // the Stream bits to write it to
+    };
+
+    LogRecord capture(shared_ptr<World> world, double stepCount, double eval, double propSlowed, double cumPropSlowed)
+    {
+        LogRecord record;
+        capture(record, world, stepCount, eval, propSlowed, cumPropSlowed);
+        return record;
+    }
+
+    // Capture into an existing record, reusing its storage.
+    void capture(LogRecord & record, shared_ptr<World> world, double stepCount, double eval, double propSlowed, double cumPropSlowed)
+    {
+        record.stepCount = stepCount;
+        record.eval = eval;
+        record.propSlowed = propSlowed;
+        record.cumPropSlowed = cumPropSlowed;
+        record.avgTau = record.avgMedianTau = record.avgFilteredTau = record.avgState = 0;
+        record.robotPos.clear();
+        record.robotAngle.clear();
+        record.robotState.clear();
+        record.puckPos.clear();
+        record.telemetry.clear();
+
         // Compute the average tau and filtered tau values for all robots.
-        double avgTau = 0;
-        double avgMedianTau = 0;
-        double avgFilteredTau = 0;
-        double avgState = 0;
-        double n = 0;
+        if (m_telemetry) {
+            const vector<double> & values = m_telemetry->getValues();
+            record.telemetry.assign(values.begin(), values.end());
+            for (size_t i = 0; i < m_tauSlots.size(); i++) {
+                record.avgTau += values[m_tauSlots[i]];
+                record.avgMedianTau += values[m_medianTauSlots[i]];
+                record.avgFilteredTau += values[m_filteredTauSlots[i]];
+                record.avgState += values[m_stateSlots[i]];
+                record.robotState.push_back((int)values[m_stateSlots[i]]);
+            }
+            if (!m_tauSlots.empty()) {
+                double n = m_tauSlots.size();
+                record.avgTau /= n;
+                record.avgMedianTau /= n;
+                record.avgFilteredTau /= n;
+                record.avgState /= n;
+            }
+        }
+
         for (auto& robot : world->getEntities("robot")) {
-            // Ugly!
-            std::shared_ptr<LassoController> lassoCtrl = std::dynamic_pointer_cast<LassoController>(robot.getComponent<CController>().controller);
-            avgTau += lassoCtrl->m_tau;
-            avgMedianTau += lassoCtrl->m_medianTau;
-            avgFilteredTau += lassoCtrl->m_filteredTau;
-            avgState += lassoCtrl->getStateAsInt();
-            ++n;
+            record.robotPos.push_back(robot.getComponent<CTransform>().p);
+            record.robotAngle.push_back(robot.getComponent<CSteer>().angle);
+        }
+
+        for (auto& puck : world->getEntities("red_puck"))
+            record.puckPos.push_back(puck.getComponent<CTransform>().p);
+    }
+
+    /**
+     * Write a record to the files.  Text streams are flushed afterwards unless 'flush' is
+     * false, which lets a writer with more records in hand flush once for all of them.
+     */
+    void write(const LogRecord & record, bool flush = true)
+    {
+        if (m_binaryLog) {
+            if (record.streams)
+                writeBinary(record);
+            return;
         }
-        if (n > 0) {
-            avgTau /= n;
-            avgMedianTau /= n;
-            avgFilteredTau /= n;
-            avgState /= n;
+
+        if (record.streams & STATS)
+            m_statsStream << record.stepCount << " " << record.eval << " " << record.propSlowed << " " << record.cumPropSlowed << " " << record.avgTau << " " << record.avgMedianTau << " " << record.avgFilteredTau << " " << record.avgState << "\n";
+
+        if (record.streams & ROBOT_STATE) {
+            m_robotStateStream << record.stepCount;
+            for (size_t i = 0; i < record.robotState.size(); i++) {
+                m_robotStateStream << " " << record.robotState[i];
+            }
+            m_robotStateStream << "\n";
         }
 
-        m_statsStream << stepCount << " " << eval << " " << propSlowed << " " << cumPropSlowed << " " << avgTau << " " << avgMedianTau << " " << avgFilteredTau << " " << avgState << "\n";
-        m_statsStream.flush();
+        if (isCompressed(m_config, "robotPose")) {
+            writeTrajectories(record);
+        } else if (record.streams & ROBOT_POSE) {
+            m_robotPoseStream << record.stepCount;
+            for (size_t i = 0; i < record.robotPos.size(); i++) {
+                const Vec2& pos = record.robotPos[i];
+                m_robotPoseStream << " " << (int)pos.x << " " << (int)pos.y << " " << ((int)(1000 * record.robotAngle[i])) / 1000.0; // Rounding angle to 3 decimals
+            }
+            m_robotPoseStream << "\n";
+        }
 
-        m_robotPoseStream << stepCount;
-        m_robotStateStream << stepCount;
-        for (auto& robot : world->getEntities("robot")) {
-            Vec2& pos = robot.getComponent<CTransform>().p;
-            CSteer& steer = robot.getComponent<CSteer>();
-            std::shared_ptr<LassoController> lassoCtrl = std::dynamic_pointer_cast<LassoController>(robot.getComponent<CController>().controller);
-            m_robotPoseStream << " " << (int)pos.x << " " << (int)pos.y << " " << ((int)(1000 * steer.angle)) / 1000.0; // Rounding angle to 3 decimals
-            m_robotStateStream << " " << lassoCtrl->getStateAsInt();
+        if (!isCompressed(m_config, "puckPosition") && (record.streams & PUCK_POSITION)) {
+            m_puckPositionStream << record.stepCount;
+            for (auto& pos : record.puckPos) {
+                m_puckPositionStream << " " << (int)pos.x << " " << (int)pos.y;
+            }
+            m_puckPositionStream << "\n";
         }
-        m_robotPoseStream << "\n";
-        m_robotStateStream << "\n";
-        m_robotPoseStream.flush();
-        m_robotStateStream.flush();
-
-        m_puckPositionStream << stepCount;
-        for (auto& puck : world->getEntities("red_puck")) {
-            Vec2& pos = puck.getComponent<CTransform>().p;
-            m_puckPositionStream << " " << (int)pos.x << " " << (int)pos.y;
+
+        if (flush) {
+            m_statsStream.flush();
+            m_robotPoseStream.flush();
+            m_robotStateStream.flush();
+            m_puckPositionStream.flush();
         }
-        m_puckPositionStream << "\n";
-        m_puckPositionStream.flush();
+    }
+
+    /**
+     * The robotPose and puckPosition streams as compressed trajectories, with the same
+     * values per frame as the text lines (x, y, angle per robot; x, y per puck), quantised
+     * to trajectoryQuantum and trajectoryAngleQuantum rather than truncated.
+     */
+    void writeTrajectories(const LogRecord & record)
+    {
+        if (!m_robotPoseTrajectory) {
+            vector<double> quanta;
+            for (size_t i = 0; i < record.robotPos.size(); i++)
+                quanta.insert(quanta.end(), { m_config.trajectoryQuantum, m_config.trajectoryQuantum, m_config.trajectoryAngleQuantum });
+            m_robotPoseTrajectory = make_unique<TrajectoryEncoder>(m_robotPoseStream.rdbuf(), quanta, m_config.trajectoryKeyframes);
+
+            quanta.assign(2 * record.puckPos.size(), m_config.trajectoryQuantum);
+            m_puckPositionTrajectory = make_unique<TrajectoryEncoder>(m_puckPositionStream.rdbuf(), quanta, m_config.trajectoryKeyframes);
+        }
+
+        vector<double> & values = m_row;
+        if (record.streams & ROBOT_POSE) {
+            values.clear();
+            for (size_t i = 0; i < record.robotPos.size(); i++)
+                values.insert(values.end(), { record.robotPos[i].x, record.robotPos[i].y, record.robotAngle[i] });
+            m_robotPoseTrajectory->append((int64_t)record.stepCount, values);
+        }
+
+        if (record.streams & PUCK_POSITION) {
+            values.clear();
+            for (auto & pos : record.puckPos)
+                values.insert(values.end(), { pos.x, pos.y });
+            m_puckPositionTrajectory->append((int64_t)record.stepCount, values);
+        }
+    }
+
+    /**
+     * One row per logged step, holding the same quantities as the four text streams but
+     * at full precision.  The schema is fixed by the first record: step, the averages of
+     * the stats columns, x, y and angle per robot, x and y per puck, then every telemetry
+     * column (eval, propSlowed and cumPropSlowed, collisions, and tau, medianTau,
+     * filteredTau, state and laps per robot), so a newly registered column is logged too.
+     */
+    void writeBinary(const LogRecord & record)
+    {
+        typedef BinaryLogWriter::Column Column;
+        if (!m_binaryLog->hasSchema()) {
+            vector<Column> columns{ { "step", BinaryLogWriter::INT64 } };
+            for (auto name : { "avgTau", "avgMedianTau", "avgFilteredTau", "avgState" })
+                columns.push_back({ name, BinaryLogWriter::FLOAT64 });
+            for (size_t i = 0; i < record.robotPos.size(); i++) {
+                string prefix = "robot" + to_string(i) + ".";
+                columns.push_back({ prefix + "x", BinaryLogWriter::FLOAT64 });
+                columns.push_back({ prefix + "y", BinaryLogWriter::FLOAT64 });
+                columns.push_back({ prefix + "angle", BinaryLogWriter::FLOAT64 });
+            }
+            for (size_t i = 0; i < record.puckPos.size(); i++) {
+                string prefix = "puck" + to_string(i) + ".";
+                columns.push_back({ prefix + "x", BinaryLogWriter::FLOAT64 });
+                columns.push_back({ prefix + "y", BinaryLogWriter::FLOAT64 });
+            }
+            if (m_telemetry) {
+                for (auto & column : m_telemetry->getColumns())
+                    columns.push_back({ column.name, (BinaryLogWriter::ColumnType)column.type });
+            }
+            m_binaryLog->setSchema(columns);
+        }
+
+        vector<double> & row = m_row;
+        row.clear();
+        row.insert(row.end(), { record.stepCount, record.avgTau, record.avgMedianTau, record.avgFilteredTau, record.avgState });
+        for (size_t i = 0; i < record.robotPos.size(); i++)
+            row.insert(row.end(), { record.robotPos[i].x, record.robotPos[i].y, record.robotAngle[i] });
+        for (auto & pos : record.puckPos)
+            row.insert(row.end(), { pos.x, pos.y });
+        row.insert(row.end(), record.telemetry.begin(), record.telemetry.end());
+        m_binaryLog->appendRow(row);
+    }
+
+    /**
+     * Log one line of the stateEvents stream, which has a line per robot at step 0 giving
+     * its initial state (with oldState equal to newState), then a line whenever a robot's
+     * controller changes state or crosses the start bar (counting a lap):
+     *
+     *   step robot oldState newState laps medianTau filteredTau
+     *
+     * Events are logged at every step, whatever writeDataSkip is.  A robot's state at a
+     * step is the newState of its last event at or before that step, as in robotState;
+     * analysis_scripts/stateevents.py reconstructs the robotState table this way.
+     */
+    void writeStateEvent(size_t stepCount, size_t robot, int oldState, int newState, int laps, double medianTau, double filteredTau)
+    {
+        m_stateEventStream << stepCount << " " << robot << " " << oldState << " " << newState << " " << laps << " " << medianTau << " " << filteredTau << "\n";
+    }
+
+    void writeToFile(shared_ptr<World> world, double stepCount, double eval, double propSlowed, double cumPropSlowed)
+    {
+        write(capture(world, stepCount, eval, propSlowed, cumPropSlowed));
     }
 
 };
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// For open, write and mkdir, which are safe to call from a signal handler
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "CWaggle.h"
+#include "Telemetry.hpp"
+
+#include "BinaryLog.hpp"
+
+using namespace std;
+
+/**
+ * Keeps the full state of the last flightRecorderSteps steps of a trial in a fixed ring,
+ * so that a failure can be examined without having logged the whole run.  Each frame holds
+ * the step, every telemetry value, and for each robot its position, velocity, heading,
+ * angular speed, speed, slowed count, contact flag and last action, and for each puck its
+ * position, velocity and contact flag.  Recording a frame is a copy into preallocated
+ * memory; nothing is written unless the trial fails.
+ *
+ * The ring is dumped to flight_<trial>.bin in the data directory when the trial aborts on
+ * a NaN evaluation, is stopped by a signal, or the process crashes (a failed assertion,
+ * a segmentation fault, ...).  The dump is a binary log (see BinaryLog.hpp) with a row per
+ * frame, oldest first, so it reads with LogReader, binlog.py or cwaggle_logreader.  The
+ * crash path only uses calls that are safe in a signal handler.
+ */
+class FlightRecorder
+{
+    size_t m_capacity;
+    size_t m_width = 0;
+    vector<double> m_frames;        // m_capacity frames of m_width values
+    size_t m_next = 0;              // the slot of the next frame
+    size_t m_count = 0;             // the frames held
+    vector<uint8_t> m_header;       // the binary log header, built once the layout is known
+    string m_dir, m_filename;
+
+    // The recorder dumped if the process crashes: the one of the running trial.
+    static FlightRecorder *& active()
+    {
+        static FlightRecorder * recorder = nullptr;
+        return recorder;
+    }
+
+    static void putLE(uint8_t * out, uint64_t value, size_t width)
+    {
+        for (size_t i = 0; i < width; i++)
+            out[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    static bool writeAll(int fd, const uint8_t * data, size_t size)
+    {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static void writeMessage(const char * text)
+    {
+        writeAll(2, (const uint8_t *)text, strlen(text));
+    }
+
+    // Write the header and the frames, oldest first, as a single chunk, column by column.
+    bool writeTo(int fd) const
+    {
+        if (!writeAll(fd, m_header.data(), m_header.size()))
+            return false;
+        uint8_t buffer[4096];
+        putLE(buffer, m_count, 4);
+        if (!writeAll(fd, buffer, 4))
+            return false;
+
+        size_t first = (m_next + m_capacity - m_count) % m_capacity;
+        for (size_t c = 0; c < m_width; c++) {
+            size_t used = 0;
+            for (size_t i = 0; i < m_count; i++) {
+                uint64_t bits;
+                memcpy(&bits, &m_frames[((first + i) % m_capacity) * m_width + c], sizeof(bits));
+                putLE(buffer + used, bits, 8);
+                used += 8;
+                if (used == sizeof(buffer)) {
+                    if (!writeAll(fd, buffer, used))
+                        return false;
+                    used = 0;
+                }
+            }
+            if (used > 0 && !writeAll(fd, buffer, used))
+                return false;
+        }
+        return true;
+    }
+
+    static void HandleCrashSignal(int signum)
+    {
+        FlightRecorder * recorder = active();
+        if (recorder && recorder->m_count > 0) {
+            mkdir(recorder->m_dir.c_str(), 0777);
+            int fd = open(recorder->m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd >= 0 && recorder->writeTo(fd)) {
+                writeMessage("Flight recorder written to ");
+                writeMessage(recorder->m_filename.c_str());
+                writeMessage("\n");
+            }
+            if (fd >= 0)
+                close(fd);
+        }
+        // The handler was reset on entry, so this ends the process as the signal would have.
+        raise(signum);
+    }
+
+public:
+    FlightRecorder(size_t capacity, const string & dataFilenameBase, int trialIndex)
+        : m_capacity(capacity)
+        , m_dir(dataFilenameBase)
+        , m_filename(dataFilenameBase + "/flight_" + to_string(trialIndex) + ".bin")
+    {
+        if (m_capacity > 0) {
+            InstallCrashHandlers();
+            active() = this;
+        }
+    }
+
+    ~FlightRecorder()
+    {
+        if (active() == this)
+            active() = nullptr;
+    }
+
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder & operator=(const FlightRecorder &) = delete;
+
+    bool enabled() const
+    {
+        return m_capacity > 0;
+    }
+
+    /**
+     * Dump the recorder of the running trial if the process is killed by SIGSEGV, SIGBUS,
+     * SIGFPE, SIGILL or SIGABRT (as from a failed assert).  The handlers run on their own
+     * stack, so a stack overflow is caught too.
+     */
+    static void InstallCrashHandlers()
+    {
+        static bool installed = false;
+        if (installed)
+            return;
+        installed = true;
+
+        static vector<char> stack(1 << 16);
+        stack_t altStack = {};
+        altStack.ss_sp = stack.data();
+        altStack.ss_size = stack.size();
+        sigaltstack(&altStack, nullptr);
+
+        struct sigaction action = {};
+        action.sa_handler = HandleCrashSignal;
+        action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        for (int signum : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT })
+            sigaction(signum, &action, nullptr);
+    }
+
+    /**
+     * Add a frame for the given step.  The layout is fixed by the first frame, so the world
+     * must keep its robots and pucks, and the telemetry its columns, from then on.
+     */
+    void record(shared_ptr<World> world, size_t step, const Telemetry & telemetry, const vector<EntityAction> & actions)
+    {
+        if (!m_capacity)
+            return;
+        auto & robots = world->getEntities("robot");
+        auto & pucks = world->getEntities("red_puck");
+        if (m_header.empty())
+            setLayout(robots.size(), pucks.size(), telemetry);
+
+        double * frame = &m_frames[m_next * m_width];
+        double * out = frame;
+        *out++ = step;
+        for (double value : telemetry.getValues())
+            *out++ = value;
+        for (size_t i = 0; i < robots.size(); i++) {
+            auto & t = robots[i].getComponent<CTransform>();
+            auto & steer = robots[i].getComponent<CSteer>();
+            EntityAction action = i < actions.size() ? actions[i] : EntityAction();
+            double values[11] = { t.p.x, t.p.y, t.v.x, t.v.y, steer.angle, steer.angularSpeed, steer.speed, (double)steer.slowedCount,
+                (double)robots[i].getComponent<CCircleBody>().collided, action.speed(), action.angularAcceleration() };
+            memcpy(out, values, sizeof(values));
+            out += 11;
+        }
+        for (auto & puck : pucks) {
+            auto & t = puck.getComponent<CTransform>();
+            double values[5] = { t.p.x, t.p.y, t.v.x, t.v.y, (double)puck.getComponent<CCircleBody>().collided };
+            memcpy(out, values, sizeof(values));
+            out += 5;
+        }
+
+        m_next = (m_next + 1) % m_capacity;
+        if (m_count < m_capacity)
+            m_count++;
+    }
+
+    // Write the ring out, giving the reason for it on stderr.
+    void dump(const string & reason)
+    {
+        if (!m_capacity || m_count == 0)
+            return;
+        if (mkdir(m_dir.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << m_dir << endl;
+        int fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || !writeTo(fd))
+            cerr << "Error writing " << m_filename << endl;
+        else
+            cerr << "Flight recorder (" << reason << "): last " << m_count << " steps written to " << m_filename << endl;
+        if (fd >= 0)
+            close(fd);
+    }
+
+private:
+    void setLayout(size_t numRobots, size_t numPucks, const Telemetry & telemetry)
+    {
+        vector<string> names{ "step" };
+        for (auto & column : telemetry.getColumns())
+            names.push_back(column.name);
+        for (size_t i = 0; i < numRobots; i++) {
+            string prefix = "robot" + to_string(i) + ".";
+            for (auto name : { "x", "y", "vx", "vy", "angle", "angularSpeed", "speed", "slowedCount", "collided", "actionSpeed", "actionAngularAcceleration" })
+                names.push_back(prefix + name);
+        }
+        for (size_t i = 0; i < numPucks; i++) {
+            string prefix = "puck" + to_string(i) + ".";
+            for (auto name : { "x", "y", "vx", "vy", "collided" })
+                names.push_back(prefix + name);
+        }
+
+        m_width = names.size();
+        m_frames.assign(m_capacity * m_width, 0);
+
+        uint8_t bytes[8];
+        m_header = { 'C', 'W', 'L', 'O', 'G', 0, 0, 0 };
+        putLE(bytes, BinaryLogWriter::Version, 4);
+        m_header.insert(m_header.end(), bytes, bytes + 4);
+        putLE(bytes, names.size(), 4);
+        m_header.insert(m_header.end(), bytes, bytes + 4);
+        for (auto & name : names) {
+            m_header.push_back(BinaryLogWriter::FLOAT64);
+            putLE(bytes, name.size(), 2);
+            m_header.insert(m_header.end(), bytes, bytes + 2);
+            m_header.insert(m_header.end(), name.begin(), name.end());
+        }
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// For fork, pipe, poll and waitpid
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Runs each task in a forked child process, with at most 'maxWorkers' children alive at
+ * once, and returns the string that each task produced (in task order).  Processes are
+ * used rather than threads because the EntityMemoryPool is a process-wide singleton which
+ * simultaneous worlds cannot safely share.  A task whose process dies yields "".
+ */
+vector<string> RunForked(const vector<function<string()>> & tasks, size_t maxWorkers)
+{
+    struct Child { size_t task; int fd; };
+
+    vector<string> results(tasks.size());
+    map<pid_t, Child> running;
+    size_t next = 0;
+    if (maxWorkers == 0)
+        maxWorkers = 1;
+
+    // Anything buffered now would otherwise be written again by every child.
+    cout.flush();
+    cerr.flush();
+
+    while (next < tasks.size() || !running.empty()) {
+        while (next < tasks.size() && running.size() < maxWorkers) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                cerr << "RunForked: pipe failed: " << strerror(errno) << endl;
+                return results;
+            }
+
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                for (auto & kv : running)
+                    close(kv.second.fd);
+
+                string out;
+                try {
+                    out = tasks[next]();
+                } catch (const exception & e) {
+                    cerr << "RunForked: task failed: " << e.what() << endl;
+                }
+
+                size_t written = 0;
+                while (written < out.size()) {
+                    ssize_t n = write(fds[1], out.data() + written, out.size() - written);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        break;
+                    written += n;
+                }
+                close(fds[1]);
+                cerr.flush();
+                _exit(0);
+            }
+
+            close(fds[1]);
+            if (pid < 0) {
+                cerr << "RunForked: fork failed: " << strerror(errno) << endl;
+                close(fds[0]);
+                return results;
+            }
+            running[pid] = Child{ next, fds[0] };
+            next++;
+        }
+
+        // Drain whichever children have output ready; EOF means the child is finished.
+        vector<pollfd> pfds;
+        vector<pid_t> pids;
+        for (auto & kv : running) {
+            pfds.push_back(pollfd{ kv.second.fd, POLLIN, 0 });
+            pids.push_back(kv.first);
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0 && errno != EINTR) {
+            cerr << "RunForked: poll failed: " << strerror(errno) << endl;
+            return results;
+        }
+
+        for (size_t i = 0; i < pfds.size(); i++) {
+            if (pfds[i].revents == 0)
+                continue;
+
+            Child & child = running[pids[i]];
+            char buffer[4096];
+            ssize_t n = read(child.fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                results[child.task].append(buffer, n);
+            } else if (n == 0 || errno != EINTR) {
+                close(child.fd);
+                waitpid(pids[i], nullptr, 0);
+                running.erase(pids[i]);
+            }
+        }
+    }
+
+    return results;
+}
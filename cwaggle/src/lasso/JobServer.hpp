@@ -0,0 +1,241 @@
+#pragma once
+
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For the Unix domain socket
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Budget.hpp"
+#include "Config.hpp"
+#include "Json.hpp"
+#include "TrialRunner.hpp"
+
+using namespace std;
+
+/**
+ * A long-lived process which accepts jobs as line-delimited JSON, either on stdin or on a
+ * Unix domain socket, and streams back one JSON line per completed trial.  The entity pool
+ * and decoded arena images stay warm between jobs, removing process startup from the inner
+ * loop of automated tuning.
+ *
+ * A job looks like this (all fields are optional):
+ *
+ *   {"id": "a1", "config": {"numRobots": 12, "filterConstant": 2.5}, "seeds": [1, 2, 3]}
+ *
+ * "config" overrides entries of lasso_config.txt using the same names.  Logs, replay
+ * records, heatmaps and flight recordings are only written for a job whose "config" gives
+ * its own "dataFilenameBase", since every job numbers its trials from 0.  The trials to run
+ * are given by "seeds" (a list), "seed" (a single seed), or "trials" (a count, using seeds
+ * 1..n as singleExperiment does).  Without any of these, numTrials is used.  A job may
+ * also give "timeBudget" (seconds) and "stepBudget" (simulated steps); once these run
+ * out, the running trial is interrupted and the remaining ones are skipped.  The replies are
+ *
+ *   {"id":"a1","trial":0,"seed":1,"eval":...,"cumPropSlowed":...,"steps":...,"aborted":false,"cached":false,
+ *    "truncated":false,"interrupted":false}
+ *   ...
+ *   {"id":"a1","done":true,"completed":3,"skipped":0,"meanEval":...}
+ *
+ * or {"id":..., "error":"..."} if the job could not be run.  The line {"cmd":"quit"}, or
+ * SIGTERM, shuts the server down.
+ */
+class JobServer
+{
+    Config m_baseConfig;
+    bool m_quit = false;
+
+    typedef function<bool(const string &)> Emitter;
+
+    static string idPrefix(const Json::Value & job)
+    {
+        return job.has("id") ? "{\"id\":" + Json::Dump(job["id"]) + "," : "{";
+    }
+
+    void runJob(const Json::Value & job, const Emitter & emit)
+    {
+        Config config = m_baseConfig;
+        for (auto & kv : job["config"].object) {
+            if (!config.set(kv.first, kv.second.toToken()))
+                throw runtime_error("unknown or invalid parameter: " + kv.first);
+        }
+        // A bad arena would otherwise end the whole server in GetWorld.
+        if (!lasso_world::IsKnownArena(config.arenaConfig))
+            throw runtime_error("unknown arenaConfig: " + config.arenaConfig);
+        // The GUI would block the server, so it is never shown for jobs.
+        config.gui = 0;
+        // Every job numbers its trials from 0, so jobs sharing a data directory would
+        // overwrite each other's logs.  A job's logs are only written if it gives its own.
+        if (!job["config"].has("dataFilenameBase")) {
+            config.writeDataSkip = 0;
+            config.replayDigestSkip = 0;
+            config.heatmapSkip = 0;
+            config.flightRecorderSteps = 0;
+            config.archiveFile = "";
+        }
+
+        vector<int> seeds;
+        if (job["seeds"].isArray()) {
+            for (auto & s : job["seeds"].array)
+                seeds.push_back((int)s.number);
+        } else if (job["seed"].isNumber()) {
+            seeds.push_back((int)job["seed"].number);
+        } else {
+            int n = job["trials"].isNumber() ? (int)job["trials"].number : (int)config.numTrials;
+            for (int i = 0; i < n; i++)
+                seeds.push_back(i + 1);
+        }
+
+        RunBudget budget(job["timeBudget"].isNumber() ? job["timeBudget"].number : 0,
+                         job["stepBudget"].isNumber() ? (size_t)job["stepBudget"].number : 0);
+
+        double totalEval = 0;
+        int completed = 0;
+        size_t i = 0;
+        for (; i < seeds.size() && !budget.shouldStop(); i++) {
+            TrialResult result = runTrial(config, (int)i, seeds[i], &budget);
+            if (!result.aborted && !result.interrupted) {
+                totalEval += result.eval;
+                completed++;
+            }
+
+            ostringstream oss;
+            oss.precision(17);
+            oss << idPrefix(job) << "\"trial\":" << result.trialIndex << ",\"seed\":" << result.rngSeed
+                << ",\"eval\":" << result.eval << ",\"cumPropSlowed\":" << result.cumPropSlowed
+                << ",\"steps\":" << result.steps << ",\"aborted\":" << (result.aborted ? "true" : "false")
+                << ",\"cached\":" << (result.cached ? "true" : "false")
+                << ",\"truncated\":" << (result.truncated ? "true" : "false")
+                << ",\"interrupted\":" << (result.interrupted ? "true" : "false") << "}";
+            if (!emit(oss.str()))
+                return;
+        }
+
+        ostringstream oss;
+        oss.precision(17);
+        oss << idPrefix(job) << "\"done\":true,\"completed\":" << completed << ",\"skipped\":" << seeds.size() - i
+            << ",\"meanEval\":" << (completed > 0 ? totalEval / completed : 0) << "}";
+        emit(oss.str());
+    }
+
+    /**
+     * Handle a single request line, passing each reply line to 'emit'.  The emitter returns
+     * false once the client has gone away.
+     */
+    void handleLine(const string & line, const Emitter & emit)
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            return;
+
+        Json::Value job;
+        try {
+            job = Json::Parse(line);
+            if (!job.isObject())
+                throw runtime_error("job must be a JSON object");
+            if (job["cmd"].isString() && job["cmd"].str == "quit") {
+                m_quit = true;
+                return;
+            }
+            runJob(job, emit);
+        } catch (const exception & e) {
+            emit(idPrefix(job) + "\"error\":" + Json::Quote(e.what()) + "}");
+        }
+    }
+
+public:
+    JobServer(const Config & config)
+        : m_baseConfig(config)
+    {
+    }
+
+    void serveStream(istream & in, ostream & out)
+    {
+        string line;
+        while (!m_quit && !StopRequested() && getline(in, line)) {
+            handleLine(line, [&out](const string & reply) {
+                out << reply << endl;
+                return out.good();
+            });
+        }
+    }
+
+    /**
+     * Listen on the given socket path, serving one client at a time until a quit command
+     * arrives.  Returns non-zero if the socket could not be set up.
+     */
+    int serveSocket(const string & path)
+    {
+        // A client disconnecting mid-reply must not kill the server.
+        signal(SIGPIPE, SIG_IGN);
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            cerr << "Socket path too long: " << path << endl;
+            return -1;
+        }
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str());
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+            cerr << "Error listening on socket " << path << ": " << strerror(errno) << endl;
+            return -1;
+        }
+        cerr << "Listening on " << path << endl;
+
+        while (!m_quit && !StopRequested()) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR)
+                    continue;
+                cerr << "Error accepting connection: " << strerror(errno) << endl;
+                break;
+            }
+
+            auto emit = [fd](const string & reply) {
+                string data = reply + "\n";
+                size_t sent = 0;
+                while (sent < data.size()) {
+                    ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+                    sent += n;
+                }
+                return true;
+            };
+
+            string pending;
+            char buffer[4096];
+            while (!m_quit && !StopRequested()) {
+                ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                pending.append(buffer, n);
+
+                size_t newline;
+                while (!m_quit && (newline = pending.find('\n')) != string::npos) {
+                    string line = pending.substr(0, newline);
+                    pending.erase(0, newline + 1);
+                    handleLine(line, emit);
+                }
+            }
+            close(fd);
+        }
+
+        close(listenFd);
+        unlink(path.c_str());
+        return 0;
+    }
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * A deliberately small JSON reader and writer.  It covers what the job protocol needs
+ * (objects, arrays, strings, numbers, booleans and null on a single line) and nothing more.
+ */
+namespace Json {
+
+struct Value
+{
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0;
+    std::string str;
+    std::vector<Value> array;
+    std::map<std::string, Value> object;
+
+    bool isNull() const { return type == Type::NUL; }
+    bool isNumber() const { return type == Type::NUMBER; }
+    bool isString() const { return type == Type::STRING; }
+    bool isArray() const { return type == Type::ARRAY; }
+    bool isObject() const { return type == Type::OBJECT; }
+
+    bool has(const std::string & key) const
+    {
+        return type == Type::OBJECT && object.count(key) > 0;
+    }
+
+    const Value & operator[](const std::string & key) const
+    {
+        static const Value null;
+        auto it = object.find(key);
+        return (type != Type::OBJECT || it == object.end()) ? null : it->second;
+    }
+
+    /**
+     * The value as it would appear in lasso_config.txt, so that it can be handed to
+     * Config::set.  Numbers that are whole are written without a fractional part.
+     */
+    std::string toToken() const
+    {
+        std::ostringstream oss;
+        switch (type) {
+            case Type::BOOL:    oss << (boolean ? 1 : 0); break;
+            case Type::STRING:  oss << str; break;
+            case Type::NUMBER:
+                oss.precision(17);
+                oss << number;
+                break;
+            default:
+                throw std::runtime_error("value cannot be used as a parameter");
+        }
+        return oss.str();
+    }
+};
+
+class Parser
+{
+    const std::string & m_text;
+    size_t m_pos = 0;
+
+    void fail(const std::string & what)
+    {
+        std::ostringstream oss;
+        oss << what << " at offset " << m_pos;
+        throw std::runtime_error(oss.str());
+    }
+
+    void skipSpace()
+    {
+        while (m_pos < m_text.size() && isspace((unsigned char)m_text[m_pos]))
+            m_pos++;
+    }
+
+    char peek()
+    {
+        skipSpace();
+        return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c)
+            fail(std::string("expected '") + c + "'");
+        m_pos++;
+    }
+
+    void expectWord(const std::string & word)
+    {
+        if (m_text.compare(m_pos, word.size(), word) != 0)
+            fail("expected '" + word + "'");
+        m_pos += word.size();
+    }
+
+    std::string parseString()
+    {
+        expect('"');
+        std::string out;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            char c = m_text[m_pos++];
+            if (c == '\\' && m_pos < m_text.size()) {
+                char e = m_text[m_pos++];
+                switch (e) {
+                    case 'n': out += '\n'; break;
+                    case 't': out += '\t'; break;
+                    case 'r': out += '\r'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'u':
+                        // Only the ASCII range is of any use for parameter values.
+                        if (m_pos + 4 > m_text.size()) { fail("bad escape"); }
+                        out += (char)strtol(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+                        m_pos += 4;
+                        break;
+                    default:   out += e; break;
+                }
+            } else {
+                out += c;
+            }
+        }
+        if (m_pos >= m_text.size())
+            fail("unterminated string");
+        m_pos++;
+        return out;
+    }
+
+    Value parseValue()
+    {
+        Value v;
+        char c = peek();
+        if (c == '{') {
+            v.type = Value::Type::OBJECT;
+            m_pos++;
+            if (peek() == '}') { m_pos++; return v; }
+            while (true) {
+                std::string key = parseString();
+                expect(':');
+                v.object[key] = parseValue();
+                if (peek() == ',') { m_pos++; continue; }
+                expect('}');
+                break;
+            }
+        } else if (c == '[') {
+            v.type = Value::Type::ARRAY;
+            m_pos++;
+            if (peek() == ']') { m_pos++; return v; }
+            while (true) {
+                v.array.push_back(parseValue());
+                if (peek() == ',') { m_pos++; continue; }
+                expect(']');
+                break;
+            }
+        } else if (c == '"') {
+            v.type = Value::Type::STRING;
+            v.str = parseString();
+        } else if (c == 't') {
+            expectWord("true");
+            v.type = Value::Type::BOOL;
+            v.boolean = true;
+        } else if (c == 'f') {
+            expectWord("false");
+            v.type = Value::Type::BOOL;
+        } else if (c == 'n') {
+            expectWord("null");
+        } else {
+            const char * start = m_text.c_str() + m_pos;
+            char * end = nullptr;
+            v.type = Value::Type::NUMBER;
+            v.number = strtod(start, &end);
+            if (end == start)
+                fail("unexpected character");
+            m_pos += end - start;
+        }
+        return v;
+    }
+
+public:
+    Parser(const std::string & text)
+        : m_text(text)
+    {
+    }
+
+    Value parse()
+    {
+        Value v = parseValue();
+        if (peek() != '\0')
+            fail("trailing characters");
+        return v;
+    }
+};
+
+inline Value Parse(const std::string & text)
+{
+    return Parser(text).parse();
+}
+
+/**
+ * Quote and escape a string for output.
+ */
+inline std::string Quote(const std::string & s)
+{
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:   out += c; break;
+        }
+    }
+    return out + "\"";
+}
+
+/**
+ * Write the given value back out as single-line JSON.
+ */
+inline std::string Dump(const Value & v)
+{
+    std::ostringstream oss;
+    oss.precision(17);
+    switch (v.type) {
+        case Value::Type::NUL:      oss << "null"; break;
+        case Value::Type::BOOL:     oss << (v.boolean ? "true" : "false"); break;
+        case Value::Type::NUMBER:   oss << v.number; break;
+        case Value::Type::STRING:   oss << Quote(v.str); break;
+        case Value::Type::ARRAY:
+            oss << "[";
+            for (size_t i = 0; i < v.array.size(); i++)
+                oss << (i > 0 ? "," : "") << Dump(v.array[i]);
+            oss << "]";
+            break;
+        case Value::Type::OBJECT: {
+            oss << "{";
+            bool first = true;
+            for (auto & kv : v.object) {
+                oss << (first ? "" : ",") << Quote(kv.first) << ":" << Dump(kv.second);
+                first = false;
+            }
+            oss << "}";
+            break;
+        }
+    }
+    return oss.str();
+}
+
+}
@@ -6,6 +6,7 @@
 #include "DigitalFilters.h"
 #include "SensorTools.hpp"
 #include "Config.hpp"
+#include "Telemetry.hpp"
 #include <math.h>
 #include <random>
 #include <algorithm>
@@ -75,6 +76,9 @@ class LassoController : public EntityController
     uniform_real_distribution<double> m_blindResetDist;
     uniform_real_distribution<double> m_blindTauDist;
 
+    Telemetry & m_telemetry;
+    Telemetry::Slot m_tauSlot, m_medianTauSlot, m_filteredTauSlot, m_stateSlot, m_lapsSlot;
+
 public:
     // m_tau represents the isoline the robot is trying to follow.  It is retained as
     // the only piece of state information in between calls to getAction.
@@ -93,6 +97,11 @@ public:
     int m_laps = 0;
     double m_lastStartBar = 0;
 
+    // Set by getAction if the state changed or the start bar was crossed, with the state
+    // held before (see DataLogger::writeStateEvent).
+    bool m_stateEvent = false;
+    State m_previousState = State::NORMAL;
+
     double m_sampleTime;
     HighPassFilter3 m_highPassFilter;
 
@@ -116,7 +125,10 @@ public:
 public:
     std::map<std::string, double> outputParams;
 
-    LassoController(Entity robot, std::shared_ptr<World> world, default_random_engine &rng, Config &config)
+    // The controller's telemetry columns are named with the given prefix (e.g. "robot0.tau")
+    // and grouped by quantity ("tau", "medianTau", "filteredTau", "state", "laps").
+    LassoController(Entity robot, std::shared_ptr<World> world, default_random_engine &rng, Config &config,
+                    Telemetry & telemetry, const std::string & telemetryPrefix)
         : m_world(world)
         , m_robot(robot)
         , m_rng(rng)
@@ -128,17 +140,27 @@ public:
         , m_escapeNoiseDistW(-0.5, 0.5)
         , m_blindResetDist(0, 1.0)
         , m_blindTauDist(m_world->getGrid(0).getMinimumAbove(0), m_world->getGrid(0).getMaximumBelow(1))
+        , m_telemetry(telemetry)
         , m_sampleTime(0.01)
         , m_highPassFilter(m_sampleTime, 2.0 * M_PI * m_config.filterConstant)
     {
         m_robotPos = m_robot.getComponent<CTransform>().p;
         m_positionQueue.push(m_robotPos);
+
+        m_tauSlot = telemetry.add(telemetryPrefix + "tau", Telemetry::FLOAT64, "tau");
+        m_medianTauSlot = telemetry.add(telemetryPrefix + "medianTau", Telemetry::FLOAT64, "medianTau");
+        m_filteredTauSlot = telemetry.add(telemetryPrefix + "filteredTau", Telemetry::FLOAT64, "filteredTau");
+        m_stateSlot = telemetry.add(telemetryPrefix + "state", Telemetry::INT32, "state");
+        m_lapsSlot = telemetry.add(telemetryPrefix + "laps", Telemetry::INT32, "laps");
+        setTelemetry();
     }
 
     EntityAction getAction()
     {
         m_robotPos = m_robot.getComponent<CTransform>().p;
         SensorTools::ReadSensorArray(m_robot, m_world, m_reading);
+        m_previousState = m_state;
+        m_stateEvent = false;
 
         if (!m_config.controllerState) {
 
@@ -198,6 +220,8 @@ public:
 
             if (m_state == State::NORMAL || m_state == State::SATISFIED)
                 escapeIfStuck();
+
+            m_stateEvent = hitStartBar || m_state != m_previousState;
         }
 
         if (m_escapeCountdown > 0)
@@ -224,6 +248,7 @@ public:
             m_visComponent.msg = ss.str();
         }
         setIndicator();
+        setTelemetry();
 
         // It is through passing 'outputParams' that we control (and debug) the live robots
         // via CWaggleBridge.py and cwaggle_bridge.so.  It is intentional that we pass
@@ -245,6 +270,10 @@ public:
         return static_cast<std::underlying_type<State>::type>(m_state);
     }
 
+    int getPreviousStateAsInt() {
+        return static_cast<std::underlying_type<State>::type>(m_previousState);
+    }
+
 private:
 
     void computeTau()
@@ -332,6 +361,15 @@ private:
         m_positionQueue.push(m_robotPos);
     }
 
+    void setTelemetry()
+    {
+        m_telemetry.set(m_tauSlot, m_tau);
+        m_telemetry.set(m_medianTauSlot, m_medianTau);
+        m_telemetry.set(m_filteredTauSlot, m_filteredTau);
+        m_telemetry.set(m_stateSlot, getStateAsInt());
+        m_telemetry.set(m_lapsSlot, m_laps);
+    }
+
     void setIndicator()
     {
         m_indicator.angle = 0;
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// For the Unix domain socket
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Config.hpp"
+#include "DataLogger.hpp"
+#include "Json.hpp"
+
+using namespace std;
+
+/**
+ * Publishes a trial's progress as it runs, for a dashboard or viewer in another process.
+ * Every liveTelemetrySkip steps one JSON datagram is sent to the Unix domain socket at
+ * liveTelemetrySocket:
+ *
+ *   {"condition":"../../data/sim_stadium_no_wall","trial":0,"step":1200,"eval":0.09,
+ *    "propSlowed":0.25,"cumPropSlowed":310,"avgTau":..,"avgMedianTau":..,"avgFilteredTau":..,
+ *    "avgState":..,"robots":[[x,y,angle],...],"pucks":[[x,y],...]}
+ *
+ * with "robots" and "pucks" every livePoseSkip steps (never if 0).  The viewer binds the
+ * socket; every trial, including those of forked workers, sends to it.  Sending never
+ * waits: if no viewer is listening or it falls behind, the datagram is dropped.
+ * analysis_scripts/live.py is a minimal viewer.
+ */
+class LiveTelemetry
+{
+    int m_fd = -1;
+    sockaddr_un m_address = {};
+    string m_prefix;                // the fields common to every message
+    size_t m_skip, m_poseSkip;
+    size_t m_dropped = 0;
+    ostringstream m_message;
+
+    void putNumber(double value)
+    {
+        if (isfinite(value))
+            m_message << value;
+        else
+            m_message << "null";
+    }
+
+public:
+    LiveTelemetry(const Config & config, int trialIndex)
+        : m_skip(config.liveTelemetrySkip)
+        , m_poseSkip(config.livePoseSkip)
+    {
+        if (config.liveTelemetrySocket.empty() || m_skip == 0)
+            return;
+        if (config.liveTelemetrySocket.size() >= sizeof(m_address.sun_path)) {
+            cerr << "liveTelemetrySocket path too long: " << config.liveTelemetrySocket << endl;
+            return;
+        }
+
+        m_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (m_fd < 0) {
+            cerr << "Error creating live telemetry socket: " << strerror(errno) << endl;
+            return;
+        }
+        fcntl(m_fd, F_SETFL, O_NONBLOCK);
+        m_address.sun_family = AF_UNIX;
+        strncpy(m_address.sun_path, config.liveTelemetrySocket.c_str(), sizeof(m_address.sun_path) - 1);
+        m_prefix = "{\"condition\":" + Json::Quote(config.dataFilenameBase) + ",\"trial\":" + to_string(trialIndex);
+        m_message.precision(6);
+    }
+
+    ~LiveTelemetry()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    LiveTelemetry(const LiveTelemetry &) = delete;
+    LiveTelemetry & operator=(const LiveTelemetry &) = delete;
+
+    bool enabled() const
+    {
+        return m_fd >= 0;
+    }
+
+    // True if a message is due at the given step.
+    bool due(size_t step) const
+    {
+        return m_fd >= 0 && step % m_skip == 0;
+    }
+
+    // Send a captured record (see DataLogger::capture) as one message, or drop it.
+    void publish(const DataLogger::LogRecord & record)
+    {
+        if (m_fd < 0)
+            return;
+
+        m_message.str("");
+        m_message << m_prefix << ",\"step\":" << (size_t)record.stepCount;
+        const char * names[] = { "eval", "propSlowed", "cumPropSlowed", "avgTau", "avgMedianTau", "avgFilteredTau", "avgState" };
+        double values[] = { record.eval, record.propSlowed, record.cumPropSlowed, record.avgTau, record.avgMedianTau, record.avgFilteredTau, record.avgState };
+        for (size_t i = 0; i < 7; i++) {
+            m_message << ",\"" << names[i] << "\":";
+            putNumber(values[i]);
+        }
+
+        if (m_poseSkip && (size_t)record.stepCount % m_poseSkip == 0) {
+            m_message << ",\"robots\":[";
+            for (size_t i = 0; i < record.robotPos.size(); i++) {
+                m_message << (i > 0 ? ",[" : "[");
+                putNumber(record.robotPos[i].x);
+                m_message << ",";
+                putNumber(record.robotPos[i].y);
+                m_message << ",";
+                putNumber(record.robotAngle[i]);
+                m_message << "]";
+            }
+            m_message << "],\"pucks\":[";
+            for (size_t i = 0; i < record.puckPos.size(); i++) {
+                m_message << (i > 0 ? ",[" : "[");
+                putNumber(record.puckPos[i].x);
+                m_message << ",";
+                putNumber(record.puckPos[i].y);
+                m_message << "]";
+            }
+            m_message << "]";
+        }
+        m_message << "}";
+
+        const string & text = m_message.str();
+        if (sendto(m_fd, text.data(), text.size(), MSG_DONTWAIT, (const sockaddr *)&m_address, sizeof(m_address)) < 0)
+            m_dropped++;
+    }
+
+    size_t getDropped() const
+    {
+        return m_dropped;
+    }
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+// For open, fstat, mmap and close
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BinaryLog.hpp"
+
+using namespace std;
+
+/**
+ * A read-only memory mapping of a whole file.  Move-only; the mapping is released when the
+ * MappedFile is destroyed.
+ */
+class MappedFile
+{
+    const uint8_t * m_data = nullptr;
+    size_t m_size = 0;
+
+public:
+    MappedFile() {}
+
+    // On failure the file is empty and errno says why.
+    explicit MappedFile(const string & filename)
+    {
+        errno = 0;
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void * p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                m_data = (const uint8_t *)p;
+                m_size = st.st_size;
+                madvise(p, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile && other)
+    {
+        *this = move(other);
+    }
+
+    MappedFile & operator=(MappedFile && other)
+    {
+        swap(m_data, other.m_data);
+        swap(m_size, other.m_size);
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        if (m_data)
+            munmap((void *)m_data, m_size);
+    }
+
+    const uint8_t * data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+};
+
+/**
+ * One column of a log.  The values are not copied: for a binary log each segment points
+ * into the mapped file (one segment per chunk, little-endian, possibly unaligned), and for
+ * a text log the single segment points at the doubles parsed by the LogReader.  A view is
+ * valid as long as the LogReader it came from.
+ */
+struct ColumnView
+{
+    struct Segment
+    {
+        const uint8_t * data;
+        size_t rows;
+    };
+
+    string name;
+    BinaryLogWriter::ColumnType type = BinaryLogWriter::FLOAT64;
+    bool mapped = false;                // values are little-endian file bytes, else native doubles
+    vector<Segment> segments;
+    vector<size_t> starts;              // the first row of each segment
+    size_t rows = 0;
+
+    size_t size() const
+    {
+        return rows;
+    }
+
+    // True if the whole column is one array, which is the case for text logs and for
+    // binary logs of one chunk (logChunkRows at least the number of rows).
+    bool contiguous() const
+    {
+        return segments.size() <= 1;
+    }
+
+    double operator[](size_t row) const
+    {
+        size_t s = upper_bound(starts.begin(), starts.end(), row) - starts.begin() - 1;
+        const uint8_t * p = segments[s].data + (row - starts[s]) * BinaryLogWriter::typeWidth(type);
+        if (!mapped) {
+            double value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        uint64_t bits = 0;
+        for (size_t i = 0; i < BinaryLogWriter::typeWidth(type); i++)
+            bits |= (uint64_t)p[i] << (8 * i);
+        switch (type) {
+        case BinaryLogWriter::INT32: return (int32_t)(uint32_t)bits;
+        case BinaryLogWriter::INT64: return (double)(int64_t)bits;
+        default: {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        }
+    }
+
+    vector<double> toVector() const
+    {
+        vector<double> values(rows);
+        for (size_t i = 0; i < rows; i++)
+            values[i] = (*this)[i];
+        return values;
+    }
+};
+
+/**
+ * Reads a log file written by cwaggle_lasso into columns, without a parsing pass for
+ * binary logs (see BinaryLog.hpp) and with a single pass over the mapped bytes for the
+ * space-separated text logs (stats, robotPose, robotState, puckPosition).  Binary columns
+ * are named by the schema; text columns are named by position ("0", "1", ...), and lines
+ * with fewer values than the widest line are padded with NaN.  A binary log whose last
+ * chunk was cut short by a killed run is read up to the last complete chunk.
+ *
+ * The Python binding is in src/cwaggle_logreader.
+ */
+class LogReader
+{
+    string m_filename;
+    string m_error;
+    MappedFile m_file;
+    bool m_binary = false;
+    vector<ColumnView> m_columns;
+    vector<vector<double>> m_text;
+    size_t m_rows = 0;
+
+    static uint64_t getLE(const uint8_t * p, size_t width)
+    {
+        uint64_t value = 0;
+        for (size_t i = 0; i < width; i++)
+            value |= (uint64_t)p[i] << (8 * i);
+        return value;
+    }
+
+    bool readBinary()
+    {
+        const uint8_t * data = m_file.data();
+        size_t size = m_file.size();
+        if (size < 16 || getLE(data + 8, 4) != BinaryLogWriter::Version) {
+            m_error = "unsupported binary log version";
+            return false;
+        }
+
+        size_t numColumns = getLE(data + 12, 4);
+        size_t offset = 16;
+        size_t rowWidth = 0;
+        for (size_t c = 0; c < numColumns; c++) {
+            if (offset + 3 > size)
+                return false;
+            ColumnView column;
+            column.type = (BinaryLogWriter::ColumnType)data[offset];
+            size_t nameLength = getLE(data + offset + 1, 2);
+            offset += 3;
+            if (offset + nameLength > size)
+                return false;
+            column.name.assign((const char *)data + offset, nameLength);
+            column.mapped = true;
+            offset += nameLength;
+            rowWidth += BinaryLogWriter::typeWidth(column.type);
+            m_columns.push_back(column);
+        }
+
+        while (offset + 4 <= size) {
+            size_t rows = getLE(data + offset, 4);
+            if (offset + 4 + rows * rowWidth > size)
+                break;
+            offset += 4;
+            for (auto & column : m_columns) {
+                column.starts.push_back(m_rows);
+                column.segments.push_back({ data + offset, rows });
+                column.rows += rows;
+                offset += rows * BinaryLogWriter::typeWidth(column.type);
+            }
+            m_rows += rows;
+        }
+        return true;
+    }
+
+public:
+    /**
+     * Parse the number between p and end, or return NaN.  Numbers of at most 15 significant
+     * digits and a power of ten within 1e22, which is all the simulator writes, take a fast
+     * path: the digits are read as an integer and scaled by the power of ten, and as both
+     * are exact doubles the result is correctly rounded.  Anything else goes to strtod
+     * (copying the token out, since the mapping is not null-terminated).
+     */
+    static double parseNumber(const char * p, const char * end)
+    {
+        static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        const char * s = p;
+        bool negative = s < end && *s == '-';
+        if (s < end && (*s == '-' || *s == '+'))
+            s++;
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool anyDigits = false;
+        for (; s < end && *s >= '0' && *s <= '9'; s++) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa > 0;
+            anyDigits = true;
+        }
+        if (s < end && *s == '.') {
+            for (s++; s < end && *s >= '0' && *s <= '9'; s++) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa > 0;
+                exponent--;
+                anyDigits = true;
+            }
+        }
+        if (anyDigits && s < end && (*s == 'e' || *s == 'E')) {
+            s++;
+            bool negativeExponent = s < end && *s == '-';
+            if (s < end && (*s == '-' || *s == '+'))
+                s++;
+            int e = 0;
+            for (; s < end && *s >= '0' && *s <= '9' && e < 10000; s++)
+                e = e * 10 + (*s - '0');
+            exponent += negativeExponent ? -e : e;
+        }
+        if (anyDigits && s == end && digits <= 15 && exponent >= -22 && exponent <= 22) {
+            double value = (double)mantissa;
+            value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+            return negative ? -value : value;
+        }
+
+        char buffer[64];
+        size_t length = min((size_t)(end - p), sizeof(buffer) - 1);
+        memcpy(buffer, p, length);
+        buffer[length] = '\0';
+        char * parsed;
+        double value = strtod(buffer, &parsed);
+        return parsed == buffer ? numeric_limits<double>::quiet_NaN() : value;
+    }
+
+private:
+
+    bool readText()
+    {
+        const char * p = (const char *)m_file.data();
+        const char * end = p + m_file.size();
+        const double nan = numeric_limits<double>::quiet_NaN();
+
+        while (p < end) {
+            const char * lineEnd = (const char *)memchr(p, '\n', end - p);
+            if (!lineEnd)
+                lineEnd = end;
+
+            size_t c = 0;
+            while (p < lineEnd) {
+                while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r'))
+                    p++;
+                if (p == lineEnd)
+                    break;
+                const char * tokenEnd = p;
+                while (tokenEnd < lineEnd && *tokenEnd != ' ' && *tokenEnd != '\t' && *tokenEnd != '\r')
+                    tokenEnd++;
+
+                if (c == m_text.size())
+                    m_text.emplace_back(m_rows, nan);
+                m_text[c++].push_back(parseNumber(p, tokenEnd));
+                p = tokenEnd;
+            }
+
+            if (c > 0) {
+                for (; c < m_text.size(); c++)
+                    m_text[c].push_back(nan);
+                m_rows++;
+            }
+            p = lineEnd + 1;
+        }
+
+        for (size_t c = 0; c < m_text.size(); c++) {
+            ColumnView column;
+            column.name = to_string(c);
+            column.segments.push_back({ (const uint8_t *)m_text[c].data(), m_rows });
+            column.starts.push_back(0);
+            column.rows = m_rows;
+            m_columns.push_back(column);
+        }
+        return true;
+    }
+
+public:
+    LogReader(const string & filename)
+        : m_filename(filename)
+        , m_file(filename)
+    {
+        if (!m_file.data()) {
+            m_error = errno ? strerror(errno) : "empty file";
+            return;
+        }
+        m_binary = m_file.size() >= 8 && memcmp(m_file.data(), "CWLOG\0\0\0", 8) == 0;
+        if (!(m_binary ? readBinary() : readText()) && m_error.empty())
+            m_error = "truncated header";
+    }
+
+    LogReader(const LogReader &) = delete;
+    LogReader & operator=(const LogReader &) = delete;
+
+    bool good() const
+    {
+        return m_error.empty();
+    }
+
+    const string & getError() const
+    {
+        return m_error;
+    }
+
+    const string & getFilename() const
+    {
+        return m_filename;
+    }
+
+    bool isBinary() const
+    {
+        return m_binary;
+    }
+
+    size_t numRows() const
+    {
+        return m_rows;
+    }
+
+    const vector<ColumnView> & getColumns() const
+    {
+        return m_columns;
+    }
+
+    // The named column, or null if there is none.
+    const ColumnView * getColumn(const string & name) const
+    {
+        for (auto & column : m_columns)
+            if (column.name == name)
+                return &column;
+        return nullptr;
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Config.hpp"
+#include "DataLogger.hpp"
+
+using namespace std;
+
+/**
+ * Decides which streams each logged step goes to, so that the volume of logs follows what
+ * is analysed.  Each text stream has its own rate (statsSkip, robotPoseSkip, robotStateSkip
+ * and puckPositionSkip, falling back on writeDataSkip), and puckPosition can be limited to
+ * the steps where some puck has moved by puckMovedThreshold since the last line.  The
+ * binary log has a single stream, at writeDataSkip.
+ *
+ * On top of that, events listed in captureTriggers ("stateChange", "nan", "wallCollision")
+ * open a capture window, in which every stream is written every captureSkip steps, from
+ * captureBefore steps before the event to captureAfter steps after it.  To reach back before
+ * the event, records are held in a delay line for captureBefore steps before being written,
+ * which keeps each stream in step order whatever the windows.
+ */
+class LogSchedule
+{
+public:
+    enum Trigger { STATE_CHANGE = 1, NAN_VALUE = 2, WALL_COLLISION = 4 };
+
+private:
+    size_t m_skips[4];              // per DataLogger stream bit, in bit order
+    size_t m_logSkip;
+    bool m_binary;
+    unsigned m_triggers = 0;
+    size_t m_captureBefore, m_captureAfter, m_captureSkip;
+    double m_puckMovedThreshold;
+
+    // The capture window covers steps up to m_windowEnd, if m_windowOpen.
+    bool m_windowOpen = false;
+    size_t m_windowEnd = 0;
+
+    deque<DataLogger::LogRecord> m_delayLine;
+    vector<DataLogger::LogRecord> m_free;
+    vector<Vec2> m_lastPucks;
+    bool m_havePucks = false;
+
+public:
+    LogSchedule(const Config & config)
+        : m_logSkip(config.writeDataSkip)
+        , m_binary(DataLogger::isBinary(config))
+        , m_captureBefore(config.captureBefore)
+        , m_captureAfter(config.captureAfter)
+        , m_captureSkip(config.captureSkip > 0 ? config.captureSkip : 1)
+        , m_puckMovedThreshold(config.puckMovedThreshold)
+    {
+        size_t skips[4] = { config.statsSkip, config.robotPoseSkip, config.robotStateSkip, config.puckPositionSkip };
+        for (size_t i = 0; i < 4; i++)
+            m_skips[i] = skips[i] > 0 ? skips[i] : config.writeDataSkip;
+
+        stringstream names(config.captureTriggers);
+        string name;
+        while (getline(names, name, ',')) {
+            if (name == "stateChange")          { m_triggers |= STATE_CHANGE; }
+            else if (name == "nan")             { m_triggers |= NAN_VALUE; }
+            else if (name == "wallCollision")   { m_triggers |= WALL_COLLISION; }
+            else if (!name.empty())             { cerr << "Unknown capture trigger: " << name << endl; }
+        }
+    }
+
+    bool hasTrigger(Trigger trigger) const
+    {
+        return m_triggers & trigger;
+    }
+
+    // True if records wait in the delay line before being written.
+    bool isDelayed() const
+    {
+        return m_triggers && m_captureBefore > 0;
+    }
+
+    // The streams a record of the given step goes to (DataLogger stream bits), 0 for none.
+    unsigned due(size_t step) const
+    {
+        if (m_logSkip == 0)
+            return 0;
+        unsigned streams = 0;
+        if (m_binary) {
+            streams = step % m_logSkip == 0 ? (unsigned)DataLogger::ALL_STREAMS : 0u;
+        } else {
+            for (size_t i = 0; i < 4; i++) {
+                if (step % m_skips[i] == 0)
+                    streams |= 1u << i;
+            }
+        }
+        if (m_windowOpen && step <= m_windowEnd && step % m_captureSkip == 0)
+            streams = DataLogger::ALL_STREAMS;
+        return streams;
+    }
+
+    // True if a record of this step must be captured, to be written or to wait for a trigger.
+    bool isCaptured(size_t step) const
+    {
+        return due(step) || (isDelayed() && step % m_captureSkip == 0);
+    }
+
+    // Open (or extend) a capture window around an event at the given step.
+    void trigger(size_t step)
+    {
+        m_windowEnd = m_windowOpen ? max(m_windowEnd, step + m_captureAfter) : step + m_captureAfter;
+        m_windowOpen = true;
+        size_t start = step > m_captureBefore ? step - m_captureBefore : 0;
+        for (auto & record : m_delayLine) {
+            if ((size_t)record.stepCount >= start && (size_t)record.stepCount % m_captureSkip == 0)
+                record.streams = DataLogger::ALL_STREAMS;
+        }
+    }
+
+    // A record to capture the given step into; it is written once ready() hands it back.
+    DataLogger::LogRecord & push(size_t step)
+    {
+        if (m_free.empty()) {
+            m_delayLine.emplace_back();
+        } else {
+            m_delayLine.push_back(move(m_free.back()));
+            m_free.pop_back();
+        }
+        DataLogger::LogRecord & record = m_delayLine.back();
+        record.streams = due(step);
+        return record;
+    }
+
+    /**
+     * The oldest record in the delay line, once no event at 'step' or later can reach back
+     * to it (or at all if 'flush'), else null.  Call pop() when done with it.
+     */
+    DataLogger::LogRecord * ready(size_t step, bool flush)
+    {
+        if (m_delayLine.empty())
+            return nullptr;
+        DataLogger::LogRecord & front = m_delayLine.front();
+        return flush || (size_t)front.stepCount + m_captureBefore < step ? &front : nullptr;
+    }
+
+    void pop()
+    {
+        m_free.push_back(move(m_delayLine.front()));
+        m_delayLine.pop_front();
+    }
+
+    /**
+     * Apply the filters to a record about to be written, in step order: puckPosition is
+     * dropped unless some puck has moved by puckMovedThreshold since its last line.
+     */
+    void filter(DataLogger::LogRecord & record)
+    {
+        if (m_binary || m_puckMovedThreshold <= 0 || !(record.streams & DataLogger::PUCK_POSITION))
+            return;
+
+        bool moved = !m_havePucks || m_lastPucks.size() != record.puckPos.size();
+        for (size_t i = 0; !moved && i < record.puckPos.size(); i++)
+            moved = record.puckPos[i].dist(m_lastPucks[i]) >= m_puckMovedThreshold;
+
+        if (moved) {
+            m_lastPucks.assign(record.puckPos.begin(), record.puckPos.end());
+            m_havePucks = true;
+        } else {
+            record.streams &= ~DataLogger::PUCK_POSITION;
+        }
+    }
+};
@@ -3,9 +3,25 @@
 #include "World.hpp"
 #include "Entity.hpp"
 #include "Components.hpp"
+#include "Telemetry.hpp"
 
 namespace LassoEval
 {
+    // The evaluation's telemetry columns, set by MyExperiment after each evaluation.
+    struct TelemetrySlots
+    {
+        Telemetry::Slot eval, propSlowed, cumPropSlowed;
+    };
+
+    TelemetrySlots RegisterTelemetry(Telemetry & telemetry)
+    {
+        TelemetrySlots slots;
+        slots.eval = telemetry.add("eval");
+        slots.propSlowed = telemetry.add("propSlowed");
+        slots.cumPropSlowed = telemetry.add("cumPropSlowed");
+        return slots;
+    }
+
     // For debuggging placement of pucks on top of other entities.
     double PucksOnTopOfAnything(std::shared_ptr<World> world, std::string puckType)
     {
@@ -7,6 +7,8 @@
 
 #include "CWaggle.h"
 #include "GUI.hpp"
+#include "Heatmap.hpp"
+#include "Telemetry.hpp"
 
 #include "MyEval.hpp"
 #include "Config.hpp"
@@ -14,6 +16,11 @@
 #include "worlds.hpp"
 #include "SpeedManager.hpp"
 #include "DataLogger.hpp"
+#include "AsyncLogWriter.hpp"
+#include "LogSchedule.hpp"
+#include "FlightRecorder.hpp"
+#include "LiveTelemetry.hpp"
+#include "ReplayRecord.hpp"
 
 using namespace std;
 
@@ -35,8 +42,47 @@ class MyExperiment {
     default_random_engine m_rng;
     bool m_aborted;
 
+    // Called before every step with the step count; returning true ends the trial early.
+    function<bool(size_t)> m_stopCheck;
+    bool m_stopped = false;
+
     SpeedManager m_speedManager;
+
+    // Metrics registered by the evaluation, the simulator and the controllers, sampled by the logger.
+    Telemetry m_telemetry;
+    LassoEval::TelemetrySlots m_evalSlots;
+
     DataLogger m_dataLogger;
+    unique_ptr<AsyncLogWriter> m_logWriter;
+    LogSchedule m_logSchedule;
+
+    // The robots and their controllers, in the order they act each step.  Without
+    // m_logWriter, logged records are captured into m_pendingRecord and written at once.
+    vector<Entity> m_robots;
+    vector<shared_ptr<LassoController>> m_lassoControllers;
+    vector<EntityAction> m_actions;
+    bool m_controlDue = false;
+    DataLogger::LogRecord m_pendingRecord;
+
+    // Rows for the StatsAggregator, collected every aggregateSkip steps.
+    DataLogger::LogRecord m_statsRecord;
+    vector<vector<double>> m_stepStats;
+
+    // Where the robots and the pucks have been, sampled every heatmapSkip steps.
+    Heatmap m_robotOccupancy, m_puckDensity;
+
+    // State digests for the ReplayRecord, every replayDigestSkip steps.
+    vector<pair<size_t, uint64_t>> m_digests;
+
+    // No logs are written before this step (see setLogStart).
+    size_t m_logStart = 0;
+
+    // The last flightRecorderSteps steps, dumped if the trial fails.
+    FlightRecorder m_flightRecorder;
+
+    // Progress sent to a viewer every liveTelemetrySkip steps.
+    LiveTelemetry m_liveTelemetry;
+    DataLogger::LogRecord m_liveRecord;
 
 public:
     MyExperiment(Config config, int trialIndex, int rngSeed)
@@ -46,31 +92,95 @@ public:
         , m_aborted(false)
         , m_speedManager(config)
         , m_dataLogger(config, trialIndex)
+        , m_logSchedule(config)
+        , m_flightRecorder(config.flightRecorderSteps, config.dataFilenameBase, trialIndex)
+        , m_liveTelemetry(config, trialIndex)
     {
+        // The simulator and some sensors draw on rand(), so it is seeded per trial too; this
+        // makes every trial reproducible on its own (see ReplayRecord.hpp).  Builds before
+        // this reseed left rand() running on from trial to trial, so their results can
+        // differ from these for the same seed.
+        srand(rngSeed);
+
+        if (m_config.writeDataSkip && m_config.logQueueSize > 0)
+            m_logWriter = make_unique<AsyncLogWriter>(m_dataLogger, m_config.logQueueSize, m_config.logQueuePolicy == "drop");
+
         resetSimulator();
+
+        if (DataLogger::hasStateEvents(m_config)) {
+            for (size_t i = 0; i < m_lassoControllers.size(); i++) {
+                auto & c = m_lassoControllers[i];
+                m_dataLogger.writeStateEvent(0, i, c->getStateAsInt(), c->getStateAsInt(), c->m_laps, c->m_medianTau, c->m_filteredTau);
+            }
+        }
     }
 
     void doSimulationStep()
     {
-        if (m_config.writeDataSkip && m_speedManager.getStepCount() % m_config.writeDataSkip == 0)
-            m_dataLogger.writeToFile(m_sim->getWorld(), m_speedManager.getStepCount(), m_eval, m_propSlowed, m_cumPropSlowed);
+        if (m_config.replayDigestSkip && m_speedManager.getStepCount() % m_config.replayDigestSkip == 0)
+            m_digests.emplace_back(m_speedManager.getStepCount(), ReplayRecord::digest(m_sim->getWorld(), m_telemetry.getValues()));
+
+        size_t step = m_speedManager.getStepCount();
+        m_flightRecorder.record(m_sim->getWorld(), step, m_telemetry, m_actions);
+
+        if (m_config.writeDataSkip && step >= m_logStart) {
+            if (captureTriggered())
+                m_logSchedule.trigger(step);
+
+            if (m_logSchedule.isDelayed()) {
+                if (m_logSchedule.isCaptured(step))
+                    m_dataLogger.capture(m_logSchedule.push(step), m_sim->getWorld(), step, m_eval, m_propSlowed, m_cumPropSlowed);
+                writeDelayedRecords(step, false);
+            } else if (unsigned streams = m_logSchedule.due(step)) {
+                if (m_logWriter) {
+                    DataLogger::LogRecord * record = m_logWriter->beginRecord();
+                    if (record) {
+                        m_dataLogger.capture(*record, m_sim->getWorld(), step, m_eval, m_propSlowed, m_cumPropSlowed);
+                        record->streams = streams;
+                        m_logSchedule.filter(*record);
+                        m_logWriter->endRecord();
+                    }
+                } else {
+                    m_dataLogger.capture(m_pendingRecord, m_sim->getWorld(), step, m_eval, m_propSlowed, m_cumPropSlowed);
+                    m_pendingRecord.streams = streams;
+                    m_logSchedule.filter(m_pendingRecord);
+                    m_dataLogger.write(m_pendingRecord);
+                }
+            }
+        }
 
-        m_speedManager.incrementStepCount();
+        if (m_liveTelemetry.due(step)) {
+            m_dataLogger.capture(m_liveRecord, m_sim->getWorld(), step, m_eval, m_propSlowed, m_cumPropSlowed);
+            m_liveTelemetry.publish(m_liveRecord);
+        }
 
-        if (!m_gui && (m_speedManager.getStepCount() % 10000 == 0)) {
-            //cout << "Simulation Step: " << m_speedManager.getStepCount() << "\n";
+        if (m_config.heatmapSkip && step % m_config.heatmapSkip == 0) {
+            for (auto & robot : m_robots) {
+                const Vec2 & p = robot.getComponent<CTransform>().p;
+                m_robotOccupancy.add(p.x, p.y);
+            }
+            for (auto & puck : m_world->getEntities("red_puck")) {
+                const Vec2 & p = puck.getComponent<CTransform>().p;
+                m_puckDensity.add(p.x, p.y);
+            }
+            m_robotOccupancy.endSample();
+            m_puckDensity.endSample();
         }
 
-        for (auto& robot : m_sim->getWorld()->getEntities("robot")) {
+        if (m_config.aggregateSkip && m_speedManager.getStepCount() % m_config.aggregateSkip == 0) {
+            DataLogger::LogRecord & r = m_statsRecord;
+            m_dataLogger.capture(r, m_sim->getWorld(), m_speedManager.getStepCount(), m_eval, m_propSlowed, m_cumPropSlowed);
+            m_stepStats.push_back({ r.stepCount, r.eval, r.propSlowed, r.cumPropSlowed, r.avgTau, r.avgMedianTau, r.avgFilteredTau, r.avgState });
+        }
 
-            EntityAction action = robot.getComponent<CController>().controller->getLastAction();
-            if (m_config.controllerSkip == 0 || m_speedManager.getStepCount() % m_config.controllerSkip == 0)
-                action = robot.getComponent<CController>().controller->getAction();
+        m_speedManager.incrementStepCount();
 
-            if (!m_config.fakeRobots)
-                action.doAction(robot, m_speedManager.getSimTimeStep());
+        if (!m_gui && (m_speedManager.getStepCount() % 10000 == 0)) {
+            //cout << "Simulation Step: " << m_speedManager.getStepCount() << "\n";
         }
 
+        m_controlDue = m_config.controllerSkip == 0 || m_speedManager.getStepCount() % m_config.controllerSkip == 0;
+        controlRobots();
         if (m_speedManager.getSimTimeStep() > 0)
             m_sim->update(m_speedManager.getSimTimeStep());
     }
@@ -84,9 +194,16 @@ public:
                 m_eval = LassoEval::PuckSSDFromIdealPosition(m_world, "red_puck", Vec2{m_config.goalX, m_config.goalY});
             m_propSlowed = LassoEval::ProportionSlowedRobots(m_world);
             m_cumPropSlowed += m_propSlowed;
+            m_telemetry.set(m_evalSlots.eval, m_eval);
+            m_telemetry.set(m_evalSlots.propSlowed, m_propSlowed);
+            m_telemetry.set(m_evalSlots.cumPropSlowed, m_cumPropSlowed);
             if (isnan(m_eval)) {
                 cerr << "nan evaluation encountered!\n";
                 m_aborted = true;
+                if (m_logSchedule.hasTrigger(LogSchedule::NAN_VALUE))
+                    m_logSchedule.trigger(m_speedManager.getStepCount());
+                m_flightRecorder.record(m_sim->getWorld(), m_speedManager.getStepCount(), m_telemetry, m_actions);
+                m_flightRecorder.dump("nan evaluation");
                 break;
             }
 
@@ -95,6 +212,11 @@ public:
                 if (m_config.maxTimeSteps > 0 && m_speedManager.getStepCount() >= m_config.maxTimeSteps) {
                     running = false;
                 }
+                if (m_stopCheck && m_stopCheck(m_speedManager.getStepCount())) {
+                    m_stopped = true;
+                    running = false;
+                    break;
+                }
                 doSimulationStep();
             }
             m_simulationTime += m_simTimer.getElapsedTimeInMilliSec();
@@ -157,6 +279,8 @@ public:
             // resetSimulator();
         }
 
+        writeDelayedRecords(m_speedManager.getStepCount(), true);
+
         if (m_gui) {
             m_gui->close();
             m_gui = NULL;
@@ -168,11 +292,63 @@ public:
         return m_aborted;
     }
 
+    void setStopCheck(function<bool(size_t)> stopCheck)
+    {
+        m_stopCheck = stopCheck;
+    }
+
+    bool wasStopped()
+    {
+        return m_stopped;
+    }
+
     double getEvaluation()
     {
         return m_eval;
     }
 
+    double getCumPropSlowed()
+    {
+        return m_cumPropSlowed;
+    }
+
+    int getStepCount()
+    {
+        return m_speedManager.getStepCount();
+    }
+
+    vector<vector<double>> & getStepStats()
+    {
+        return m_stepStats;
+    }
+
+    const Heatmap & getRobotOccupancy()
+    {
+        return m_robotOccupancy;
+    }
+
+    const Heatmap & getPuckDensity()
+    {
+        return m_puckDensity;
+    }
+
+    const vector<pair<size_t, uint64_t>> & getDigests()
+    {
+        return m_digests;
+    }
+
+    // Write out the flight recorder, if enabled, e.g. when the trial was stopped by a signal.
+    void dumpFlightRecorder(const string & reason)
+    {
+        m_flightRecorder.dump(reason);
+    }
+
+    // Write the logs only from the given step on, e.g. for replaying part of a trial.
+    void setLogStart(size_t step)
+    {
+        m_logStart = step;
+    }
+
 private:
     void resetSimulator()
     {
@@ -185,15 +361,119 @@ private:
 
         m_sim = make_shared<Simulator>(m_world);
 
+        if (m_config.heatmapSkip) {
+            // The half-life is given in steps, the Heatmap's in samples.
+            double halfLife = m_config.heatmapHalfLife / m_config.heatmapSkip;
+            m_robotOccupancy = Heatmap(m_world->width(), m_world->height(), m_config.heatmapCellSize, halfLife);
+            m_puckDensity = Heatmap(m_world->width(), m_world->height(), m_config.heatmapCellSize, halfLife);
+        }
+
+        m_telemetry = Telemetry();
+        m_evalSlots = LassoEval::RegisterTelemetry(m_telemetry);
+        m_sim->registerTelemetry(m_telemetry);
+
         if (m_gui) {
             m_gui->setSim(m_sim);
         } else if (m_config.gui) {
-            m_gui = make_shared<GUI>(m_sim, 144);
+            string videoFilename;
+            if (!m_config.videoFilenameBase.empty())
+                videoFilename = m_config.videoFilenameBase + to_string(m_trialIndex) + "." + m_config.videoFormat;
+            // Screenshots read the window, so they need it drawn on this thread.
+            m_gui = make_shared<GUI>(m_sim, 144, m_config.renderThread && !m_config.captureScreenshots, videoFilename, m_config.videoFrameRate);
             m_gui->setKeyboardCallback(&m_speedManager);
+            if (m_config.heatmapSkip)
+                m_gui->setHeatmap(&m_robotOccupancy);
         }
 
+        size_t robotIndex = 0;
         for (auto e : m_world->getEntities("robot")) {
-            e.addComponent<CController>(make_shared<LassoController>(e, m_world, m_rng, m_config));
+            string prefix = "robot" + to_string(robotIndex++) + ".";
+            e.addComponent<CController>(make_shared<LassoController>(e, m_world, m_rng, m_config, m_telemetry, prefix));
+        }
+        m_dataLogger.setTelemetry(m_telemetry);
+
+        findRobots();
+    }
+
+    // True if an event of the last step is one of the captureTriggers (see LogSchedule.hpp).
+    bool captureTriggered()
+    {
+        if (m_logSchedule.hasTrigger(LogSchedule::STATE_CHANGE) && m_controlDue) {
+            for (auto & c : m_lassoControllers) {
+                if (c->m_stateEvent)
+                    return true;
+            }
+        }
+        if (m_logSchedule.hasTrigger(LogSchedule::WALL_COLLISION) && m_sim->getWallCollisions() > 0)
+            return true;
+        if (m_logSchedule.hasTrigger(LogSchedule::NAN_VALUE)) {
+            for (double value : m_telemetry.getValues()) {
+                if (isnan(value))
+                    return true;
+            }
+            for (auto & robot : m_robots) {
+                const Vec2 & p = robot.getComponent<CTransform>().p;
+                if (isnan(p.x) || isnan(p.y))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Hand the records leaving the delay line to the writer (all of them if 'flush'),
+     * swapping storage with the writer's slot rather than copying.
+     */
+    void writeDelayedRecords(size_t step, bool flush)
+    {
+        while (DataLogger::LogRecord * record = m_logSchedule.ready(step, flush)) {
+            m_logSchedule.filter(*record);
+            if (record->streams && m_logWriter) {
+                DataLogger::LogRecord * slot = m_logWriter->beginRecord();
+                if (slot) {
+                    swap(*slot, *record);
+                    m_logWriter->endRecord();
+                }
+            } else if (record->streams) {
+                m_dataLogger.write(*record);
+            }
+            m_logSchedule.pop();
+        }
+    }
+
+    // Log the controllers that changed state or crossed the start bar in this step.
+    void logStateEvents()
+    {
+        for (size_t i = 0; i < m_lassoControllers.size(); i++) {
+            auto & c = m_lassoControllers[i];
+            if (c->m_stateEvent)
+                m_dataLogger.writeStateEvent(m_speedManager.getStepCount(), i, c->getPreviousStateAsInt(), c->getStateAsInt(), c->m_laps, c->m_medianTau, c->m_filteredTau);
+        }
+    }
+
+    // Collect the robots and their controllers once per reset.
+    void findRobots()
+    {
+        m_robots = m_world->getEntities("robot");
+        m_lassoControllers.clear();
+        for (auto & robot : m_robots)
+            m_lassoControllers.push_back(dynamic_pointer_cast<LassoController>(robot.getComponent<CController>().controller));
+        m_actions.assign(m_robots.size(), EntityAction());
+    }
+
+    /**
+     * Each robot senses, decides and acts in turn.  A robot's action changes its heading,
+     * which the robots after it may sense, so the order matters.
+     */
+    void controlRobots()
+    {
+        for (size_t i = 0; i < m_robots.size(); i++) {
+            auto & controller = m_robots[i].getComponent<CController>().controller;
+            m_actions[i] = m_controlDue ? controller->getAction() : controller->getLastAction();
+            if (!m_config.fakeRobots)
+                m_actions[i].doAction(m_robots[i], m_speedManager.getSimTimeStep());
         }
+        if (m_controlDue && DataLogger::hasStateEvents(m_config))
+            logStateEvents();
     }
 };
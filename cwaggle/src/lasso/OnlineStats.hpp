@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Running mean and variance by Welford's algorithm, which is numerically stable and needs
+ * no memory of the samples.
+ */
+class RunningStats
+{
+    size_t m_n = 0;
+    double m_mean = 0;
+    double m_m2 = 0;
+
+public:
+    void add(double x)
+    {
+        m_n++;
+        double delta = x - m_mean;
+        m_mean += delta / m_n;
+        m_m2 += delta * (x - m_mean);
+    }
+
+    size_t count() const
+    {
+        return m_n;
+    }
+
+    double mean() const
+    {
+        return m_n > 0 ? m_mean : numeric_limits<double>::quiet_NaN();
+    }
+
+    // The sample variance (dividing by n - 1).
+    double variance() const
+    {
+        return m_n > 1 ? m_m2 / (m_n - 1) : 0;
+    }
+
+    double stddev() const
+    {
+        return sqrt(variance());
+    }
+};
+
+/**
+ * A merging t-digest (Dunning & Ertl) for estimating quantiles in bounded memory.  Samples
+ * are buffered and merged into at most about 'compression' centroids, which are kept small
+ * near the tails (using the arcsine scale function) so that extreme quantiles stay accurate.
+ * With fewer samples than centroids the quantiles are exact up to interpolation.
+ */
+class TDigest
+{
+    double m_compression;
+    vector<pair<double, double>> m_centroids;   // (mean, weight), sorted by mean
+    vector<double> m_buffer;
+    double m_count = 0;
+    double m_min = numeric_limits<double>::infinity();
+    double m_max = -numeric_limits<double>::infinity();
+
+    double scale(double q) const
+    {
+        return m_compression * (asin(2 * q - 1) / M_PI + 0.5);
+    }
+
+    double inverseScale(double k) const
+    {
+        return (sin((k / m_compression - 0.5) * M_PI) + 1) / 2;
+    }
+
+    void compress()
+    {
+        if (m_buffer.empty())
+            return;
+
+        vector<pair<double, double>> all = m_centroids;
+        for (double x : m_buffer)
+            all.emplace_back(x, 1.0);
+        m_buffer.clear();
+        sort(all.begin(), all.end());
+
+        m_centroids.clear();
+        pair<double, double> current = all[0];
+        double soFar = 0;
+        double qLimit = inverseScale(scale(0) + 1);
+        for (size_t i = 1; i < all.size(); i++) {
+            double q = (soFar + current.second + all[i].second) / m_count;
+            if (q <= qLimit) {
+                double weight = current.second + all[i].second;
+                current.first += (all[i].first - current.first) * all[i].second / weight;
+                current.second = weight;
+            } else {
+                m_centroids.push_back(current);
+                soFar += current.second;
+                qLimit = inverseScale(scale(soFar / m_count) + 1);
+                current = all[i];
+            }
+        }
+        m_centroids.push_back(current);
+    }
+
+public:
+    TDigest(double compression = 100)
+        : m_compression(compression)
+    {
+    }
+
+    void add(double x)
+    {
+        m_buffer.push_back(x);
+        m_count++;
+        m_min = min(m_min, x);
+        m_max = max(m_max, x);
+        if (m_buffer.size() >= 5 * m_compression)
+            compress();
+    }
+
+    double count() const
+    {
+        return m_count;
+    }
+
+    /**
+     * Estimate the q-th quantile (0 <= q <= 1) by interpolating between the centres of
+     * adjacent centroids, and between the extreme centroids and the observed min and max.
+     */
+    double quantile(double q)
+    {
+        compress();
+        if (m_centroids.empty())
+            return numeric_limits<double>::quiet_NaN();
+        if (m_centroids.size() == 1)
+            return m_centroids[0].first;
+
+        double target = q * m_count;
+        double first = m_centroids.front().second / 2;
+        if (target <= first)
+            return m_min + (m_centroids.front().first - m_min) * (first > 0 ? target / first : 0);
+
+        double cumulative = 0;
+        for (size_t i = 0; i + 1 < m_centroids.size(); i++) {
+            double centre = cumulative + m_centroids[i].second / 2;
+            double nextCentre = cumulative + m_centroids[i].second + m_centroids[i + 1].second / 2;
+            if (target <= nextCentre) {
+                double t = (target - centre) / (nextCentre - centre);
+                return m_centroids[i].first + t * (m_centroids[i + 1].first - m_centroids[i].first);
+            }
+            cumulative += m_centroids[i].second;
+        }
+
+        double last = m_centroids.back().second / 2;
+        double t = min(1.0, (target - (m_count - last)) / last);
+        return m_centroids.back().first + t * (m_max - m_centroids.back().first);
+    }
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// For mkdir
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "Config.hpp"
+#include "ForkPool.hpp"
+#include "TrialRunner.hpp"
+
+using namespace std;
+
+/**
+ * Tunes numeric Config parameters by minimizing the mean final evaluation over a fixed set
+ * of seeds.  Candidates are evaluated in parallel batches of forked workers, each running
+ * its seeds one after the other through runTrial (so the result cache applies).  Two
+ * search methods are available through optimMethod:
+ *
+ *   random  - uniform random search within the bounds
+ *   cmaes   - separable CMA-ES (diagonal covariance; Ros & Hansen, 2008)
+ *
+ * The parameters to tune are given as optimParams, e.g.
+ *
+ *   optimParams filterConstant:0.5:10,escapeDuration:0:50,robotSensingDistance:30:200
+ *
+ * A candidate is rejected early once optimRejectAfter seeds have been run and its mean
+ * so far exceeds optimRejectFactor times the best mean found.  Every candidate is written
+ * to optim_history.dat, and the best configuration to optim_best.txt (in a form which can
+ * be used as lasso_config.txt).
+ */
+class Optimiser
+{
+    struct Param
+    {
+        string name;
+        double lo, hi;
+        bool integral;
+    };
+
+    struct Candidate
+    {
+        vector<double> x;       // normalized to [0, 1] in each dimension
+        double objective = numeric_limits<double>::infinity();
+        int seedsRun = 0;
+        bool rejected = false;
+    };
+
+    Config m_config;
+    vector<Param> m_params;
+    vector<int> m_seeds;
+    default_random_engine m_rng;
+    ofstream m_history;
+
+    Candidate m_best;
+    size_t m_evaluated = 0;
+    size_t m_generation = 0;
+
+    bool parseParams()
+    {
+        stringstream spec(m_config.optimParams);
+        string item;
+        while (getline(spec, item, ',')) {
+            Param p;
+            stringstream fields(item);
+            string lo, hi;
+            if (!getline(fields, p.name, ':') || !getline(fields, lo, ':') || !getline(fields, hi, ':')) {
+                cerr << "Optimiser: expected name:low:high in optimParams, got: " << item << endl;
+                return false;
+            }
+            p.lo = atof(lo.c_str());
+            p.hi = atof(hi.c_str());
+
+            bool found = false, numeric = false;
+            m_config.visit([&](const char * name, auto & value) {
+                typedef typename decay<decltype(value)>::type T;
+                if (p.name == name) {
+                    found = true;
+                    numeric = is_arithmetic<T>::value;
+                    p.integral = is_integral<T>::value;
+                }
+            });
+            if (!found || !numeric || !(p.hi > p.lo)) {
+                cerr << "Optimiser: not a numeric parameter with low < high: " << item << endl;
+                return false;
+            }
+            m_params.push_back(p);
+        }
+        return !m_params.empty();
+    }
+
+    double toValue(size_t i, double x) const
+    {
+        double v = m_params[i].lo + min(1.0, max(0.0, x)) * (m_params[i].hi - m_params[i].lo);
+        return m_params[i].integral ? round(v) : v;
+    }
+
+    Config toConfig(const vector<double> & x) const
+    {
+        Config config = m_config;
+        for (size_t i = 0; i < m_params.size(); i++) {
+            ostringstream oss;
+            oss.precision(17);
+            oss << toValue(i, x[i]);
+            config.set(m_params[i].name, oss.str());
+        }
+        // Workers run side by side, so they must not show a GUI or share log files.
+        config.gui = 0;
+        config.writeDataSkip = 0;
+        config.heatmapSkip = 0;
+        config.replayDigestSkip = 0;
+        config.flightRecorderSteps = 0;
+        return config;
+    }
+
+    /**
+     * Run the seeds for one candidate, stopping early if its running mean rises above
+     * 'rejectAbove'.  Aborted trials count as the worst possible evaluation of 1.
+     * Returns "objective seedsRun rejected" for transport back from the worker.
+     */
+    string evaluate(const Config & config, double rejectAbove) const
+    {
+        double total = 0;
+        int n = 0;
+        bool rejected = false;
+        for (size_t i = 0; i < m_seeds.size(); i++) {
+            TrialResult result = runTrial(config, (int)i, m_seeds[i]);
+            total += result.aborted ? 1.0 : result.eval;
+            n++;
+            if (m_config.optimRejectAfter > 0 && (size_t)n >= m_config.optimRejectAfter
+                && n < (int)m_seeds.size() && total / n > rejectAbove) {
+                rejected = true;
+                break;
+            }
+        }
+
+        ostringstream oss;
+        oss.precision(17);
+        oss << total / n << " " << n << " " << rejected;
+        return oss.str();
+    }
+
+    void evaluateBatch(vector<Candidate> & batch)
+    {
+        double rejectAbove = numeric_limits<double>::infinity();
+        if (isfinite(m_best.objective))
+            rejectAbove = m_config.optimRejectFactor * m_best.objective;
+
+        vector<function<string()>> tasks;
+        for (auto & c : batch) {
+            Config config = toConfig(c.x);
+            tasks.push_back([this, config, rejectAbove]() { return evaluate(config, rejectAbove); });
+        }
+        vector<string> results = RunForked(tasks, m_config.optimWorkers);
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            Candidate & c = batch[i];
+            istringstream iss(results[i]);
+            if (!(iss >> c.objective >> c.seedsRun >> c.rejected))
+                c.objective = numeric_limits<double>::infinity();
+
+            m_history << m_evaluated << " " << m_generation;
+            for (size_t j = 0; j < m_params.size(); j++)
+                m_history << " " << toValue(j, c.x[j]);
+            m_history << " " << c.objective << " " << c.seedsRun << " " << c.rejected << "\n";
+            m_evaluated++;
+
+            if (!c.rejected && c.objective < m_best.objective) {
+                m_best = c;
+                cout << "Evaluation " << m_evaluated << ": new best " << c.objective << endl;
+            }
+        }
+        m_history.flush();
+        m_generation++;
+    }
+
+    void runRandom()
+    {
+        uniform_real_distribution<double> uniform(0, 1);
+        while (m_evaluated < m_config.optimEvaluations) {
+            size_t n = min(m_config.optimBatchSize, m_config.optimEvaluations - m_evaluated);
+            vector<Candidate> batch(n);
+            for (auto & c : batch) {
+                c.x.resize(m_params.size());
+                for (auto & xi : c.x)
+                    xi = uniform(m_rng);
+            }
+            evaluateBatch(batch);
+        }
+    }
+
+    void runCMAES()
+    {
+        size_t n = m_params.size();
+        size_t lambda = max((size_t)2, m_config.optimBatchSize);
+        size_t mu = lambda / 2;
+
+        vector<double> weights(mu);
+        double sumW = 0, sumW2 = 0;
+        for (size_t i = 0; i < mu; i++) {
+            weights[i] = log(mu + 0.5) - log(i + 1.0);
+            sumW += weights[i];
+        }
+        for (auto & w : weights) {
+            w /= sumW;
+            sumW2 += w * w;
+        }
+        double muEff = 1.0 / sumW2;
+
+        double cSigma = (muEff + 2) / (n + muEff + 5);
+        double dSigma = 1 + 2 * max(0.0, sqrt((muEff - 1) / (n + 1)) - 1) + cSigma;
+        double cc = 4.0 / (n + 4);
+        double c1 = (n + 2) / 3.0 * 2 / ((n + 1.3) * (n + 1.3) + muEff);
+        double cMu = min(1 - c1, (n + 2) / 3.0 * 2 * (muEff - 2 + 1 / muEff) / ((n + 2) * (n + 2) + muEff));
+        double chiN = sqrt((double)n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+        // Start from the values in the config file.
+        vector<double> mean(n), diagC(n, 1.0), pSigma(n, 0.0), pc(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            double value = 0;
+            m_config.visit([&](const char * name, auto & v) {
+                if constexpr (is_arithmetic<typename decay<decltype(v)>::type>::value) {
+                    if (m_params[i].name == name)
+                        value = (double)v;
+                }
+            });
+            mean[i] = min(1.0, max(0.0, (value - m_params[i].lo) / (m_params[i].hi - m_params[i].lo)));
+        }
+        double sigma = 0.3;
+
+        normal_distribution<double> normal(0, 1);
+        for (size_t g = 0; m_evaluated < m_config.optimEvaluations; g++) {
+            size_t count = min(lambda, m_config.optimEvaluations - m_evaluated);
+            vector<Candidate> batch(count);
+            vector<vector<double>> ys(count, vector<double>(n));
+            for (size_t k = 0; k < count; k++) {
+                batch[k].x.resize(n);
+                for (size_t i = 0; i < n; i++) {
+                    // Sample, then clip to the bounds and use the clipped step for the update.
+                    double x = mean[i] + sigma * sqrt(diagC[i]) * normal(m_rng);
+                    batch[k].x[i] = min(1.0, max(0.0, x));
+                    ys[k][i] = (batch[k].x[i] - mean[i]) / sigma;
+                }
+            }
+            evaluateBatch(batch);
+            if (count < lambda)
+                break;
+
+            vector<size_t> order(count);
+            for (size_t k = 0; k < count; k++)
+                order[k] = k;
+            sort(order.begin(), order.end(), [&batch](size_t a, size_t b) {
+                return batch[a].objective < batch[b].objective;
+            });
+
+            vector<double> yw(n, 0.0);
+            for (size_t j = 0; j < mu; j++)
+                for (size_t i = 0; i < n; i++)
+                    yw[i] += weights[j] * ys[order[j]][i];
+
+            double normPSigma = 0;
+            for (size_t i = 0; i < n; i++) {
+                mean[i] = min(1.0, max(0.0, mean[i] + sigma * yw[i]));
+                pSigma[i] = (1 - cSigma) * pSigma[i] + sqrt(cSigma * (2 - cSigma) * muEff) * yw[i] / sqrt(diagC[i]);
+                normPSigma += pSigma[i] * pSigma[i];
+            }
+            normPSigma = sqrt(normPSigma);
+
+            bool hSigma = normPSigma / sqrt(1 - pow(1 - cSigma, 2.0 * (g + 1))) < (1.4 + 2.0 / (n + 1)) * chiN;
+            for (size_t i = 0; i < n; i++) {
+                pc[i] = (1 - cc) * pc[i] + (hSigma ? sqrt(cc * (2 - cc) * muEff) * yw[i] : 0);
+                double rankMu = 0;
+                for (size_t j = 0; j < mu; j++)
+                    rankMu += weights[j] * ys[order[j]][i] * ys[order[j]][i];
+                diagC[i] = (1 - c1 - cMu) * diagC[i]
+                         + c1 * (pc[i] * pc[i] + (hSigma ? 0 : cc * (2 - cc) * diagC[i]))
+                         + cMu * rankMu;
+            }
+            sigma *= exp((cSigma / dSigma) * (normPSigma / chiN - 1));
+            sigma = min(sigma, 1.0);
+        }
+    }
+
+public:
+    Optimiser(const Config & config)
+        : m_config(config)
+        , m_rng(1)
+    {
+        size_t numSeeds = m_config.optimSeeds > 0 ? m_config.optimSeeds : m_config.numTrials;
+        for (size_t i = 0; i < numSeeds; i++)
+            m_seeds.push_back((int)i + 1);
+    }
+
+    int run()
+    {
+        if (!parseParams() || m_seeds.empty())
+            return -1;
+        if (m_config.optimMethod != "random" && m_config.optimMethod != "cmaes") {
+            cerr << "Optimiser: unknown optimMethod: " << m_config.optimMethod << endl;
+            return -1;
+        }
+
+        if (mkdir(m_config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << m_config.dataFilenameBase << endl;
+        m_history = ofstream(m_config.dataFilenameBase + "/optim_history.dat");
+        m_history.precision(10);
+        m_history << "# evaluation generation";
+        for (auto & p : m_params)
+            m_history << " " << p.name;
+        m_history << " objective seedsRun rejected\n";
+
+        if (m_config.optimMethod == "random")
+            runRandom();
+        else
+            runCMAES();
+
+        if (m_best.x.empty()) {
+            cerr << "Optimiser: no candidate completed." << endl;
+            return -1;
+        }
+
+        // The best configuration is meant to be run again as is, so it keeps the outputs
+        // that toConfig turned off for the workers.
+        Config best = toConfig(m_best.x);
+        best.writeDataSkip = m_config.writeDataSkip;
+        best.gui = m_config.gui;
+        best.heatmapSkip = m_config.heatmapSkip;
+        best.replayDigestSkip = m_config.replayDigestSkip;
+        best.flightRecorderSteps = m_config.flightRecorderSteps;
+        ofstream bestOut(m_config.dataFilenameBase + "/optim_best.txt");
+        best.save(bestOut);
+
+        cout << "Best objective: " << m_best.objective << endl;
+        for (size_t i = 0; i < m_params.size(); i++)
+            cout << "\t" << m_params[i].name << ": " << toValue(i, m_best.x[i]) << endl;
+        return 0;
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// For mkdir
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "CWaggle.h"
+
+#include "Config.hpp"
+#include "DataLogger.hpp"
+#include "ResultCache.hpp"
+#include "SweepArchive.hpp"
+#include "TrialResult.hpp"
+
+using namespace std;
+
+/**
+ * Everything needed to re-simulate a trial exactly, in place of its full logs: the
+ * configuration, the seed, the code version, and a digest of the simulation state every
+ * replayDigestSkip steps.  Written as replay_<trial>.txt in the trial's data directory:
+ *
+ *   cwaggle-replay 1
+ *   codeVersion <git describe>
+ *   key <hash of the ResultCache key text>
+ *   trialIndex <i>
+ *   rngSeed <seed>
+ *   config
+ *   <the configuration, as in lasso_config.txt>
+ *   end
+ *   digest <step> <16 hex digits>
+ *   ...
+ *   result <steps> <eval>
+ *
+ * A trial's run depends only on its configuration and seed (MyExperiment seeds both its
+ * own generator and rand()), so "cwaggle_lasso --replay" can run it again with full
+ * logging and compare the digests on the way to catch any divergence, for instance after
+ * a change of code or compiler.
+ */
+struct ReplayRecord
+{
+    string codeVersion;
+    string key;
+    int trialIndex = 0;
+    int rngSeed = 0;
+    Config config;
+    vector<pair<size_t, uint64_t>> digests;
+    size_t steps = 0;
+    double eval = 0;
+
+    // FNV-1a over the bytes of the given values.
+    static void addToDigest(uint64_t & h, const void * data, size_t size)
+    {
+        const unsigned char * p = (const unsigned char *)data;
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+    }
+
+    /**
+     * A digest of the simulation state: the position, velocity and heading of every robot,
+     * the position and velocity of every puck, and the telemetry values (which include the
+     * controllers' tau, state and lap count).  Doubles are hashed bit for bit, so any
+     * difference at all shows.
+     */
+    static uint64_t digest(shared_ptr<World> world, const vector<double> & telemetry)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (auto & robot : world->getEntities("robot")) {
+            auto & t = robot.getComponent<CTransform>();
+            double values[5] = { t.p.x, t.p.y, t.v.x, t.v.y, robot.getComponent<CSteer>().angle };
+            addToDigest(h, values, sizeof(values));
+        }
+        for (auto & puck : world->getEntities("red_puck")) {
+            auto & t = puck.getComponent<CTransform>();
+            double values[4] = { t.p.x, t.p.y, t.v.x, t.v.y };
+            addToDigest(h, values, sizeof(values));
+        }
+        addToDigest(h, telemetry.data(), telemetry.size() * sizeof(double));
+        return h;
+    }
+
+    static string getFilename(const Config & config, int trialIndex)
+    {
+        return config.dataFilenameBase + "/replay_" + to_string(trialIndex) + ".txt";
+    }
+
+    void save(ostream & out)
+    {
+        auto oldPrecision = out.precision(17);
+        out << "cwaggle-replay 1\n"
+            << "codeVersion " << codeVersion << "\n"
+            << "key " << key << "\n"
+            << "trialIndex " << trialIndex << "\n"
+            << "rngSeed " << rngSeed << "\n"
+            << "config\n";
+        config.save(out);
+        out << "end\n";
+        for (auto & d : digests)
+            out << "digest " << d.first << " " << hex << setw(16) << setfill('0') << d.second << dec << setfill(' ') << "\n";
+        out << "result " << steps << " " << eval << "\n";
+        out.precision(oldPrecision);
+    }
+
+    bool load(istream & in)
+    {
+        string token;
+        if (!(in >> token >> token) || token != "1")
+            return false;
+        bool haveResult = false;
+        while (in >> token) {
+            if (token == "codeVersion")     { in >> codeVersion; }
+            else if (token == "key")        { in >> key; }
+            else if (token == "trialIndex") { in >> trialIndex; }
+            else if (token == "rngSeed")    { in >> rngSeed; }
+            else if (token == "config") {
+                config = Config();
+                while (in >> token && token != "end") {
+                    if (!config.set(token, in))
+                        cerr << "Unknown parameter in replay record: " << token << endl;
+                }
+            } else if (token == "digest") {
+                size_t step;
+                uint64_t value;
+                in >> step >> hex >> value >> dec;
+                digests.emplace_back(step, value);
+            } else if (token == "result") {
+                haveResult = (bool)(in >> steps >> eval);
+            }
+        }
+        return haveResult;
+    }
+
+    /**
+     * Save the replay record of a finished trial where its logs would go: a file in
+     * config.dataFilenameBase, or an entry of the SweepArchive.
+     */
+    static void write(const Config & config, const TrialResult & result)
+    {
+        if (result.replayRecord.empty())
+            return;
+        if (DataLogger::isArchived(config)) {
+            SweepArchive::append(config.archiveFile, config.dataFilenameBase, result.trialIndex, "replay.txt", result.replayRecord);
+            return;
+        }
+
+        if (mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << config.dataFilenameBase << endl;
+        ofstream fout(getFilename(config, result.trialIndex));
+        fout << result.replayRecord;
+        if (!fout)
+            cerr << "Error writing " << getFilename(config, result.trialIndex) << endl;
+    }
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CWaggle.h"
+#include "GUI.hpp"
+#include "KeyboardCallback.hpp"
+
+#include "Budget.hpp"
+#include "Config.hpp"
+#include "LassoController.hpp"
+#include "LogReader.hpp"
+#include "TrajectoryCodec.hpp"
+#include "worlds.hpp"
+
+using namespace std;
+
+/**
+ * One logged stream of a trial: the logged steps and, for each, a row of 'width' values.
+ */
+struct ReplayTrack
+{
+    vector<double> steps;
+    size_t width = 0;
+    vector<double> values;
+
+    bool empty() const
+    {
+        return steps.empty();
+    }
+
+    const double * row(size_t i) const
+    {
+        return &values[i * width];
+    }
+
+    // The last row logged at or before the step, or the first row if there is none.
+    size_t rowAt(double step) const
+    {
+        size_t i = upper_bound(steps.begin(), steps.end(), step) - steps.begin();
+        return i > 0 ? i - 1 : 0;
+    }
+
+    // Add the rows of the named columns of a log, skipping rows where the first is NaN.
+    void addColumns(const LogReader & log, const string & stepName, const vector<string> & names)
+    {
+        const ColumnView * step = log.getColumn(stepName);
+        vector<const ColumnView *> columns;
+        for (auto & name : names)
+            columns.push_back(log.getColumn(name));
+        width = names.size();
+        for (size_t r = 0; step && r < log.numRows(); r++) {
+            if (width > 0 && columns[0] && isnan((*columns[0])[r]))
+                continue;
+            steps.push_back((*step)[r]);
+            for (auto column : columns)
+                values.push_back(column ? (*column)[r] : NAN);
+        }
+    }
+
+    // Read a text log or a compressed trajectory, whose lines are "step value value ...".
+    bool load(const string & filename)
+    {
+        if (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".trj") == 0) {
+            TrajectoryDecoder decoder(filename);
+            if (!decoder.good())
+                return false;
+            int64_t step;
+            vector<double> row;
+            while (decoder.next(step, row)) {
+                width = row.size();
+                steps.push_back(step);
+                values.insert(values.end(), row.begin(), row.end());
+            }
+            return true;
+        }
+
+        LogReader log(filename);
+        if (!log.good())
+            return false;
+        vector<string> names;
+        for (size_t c = 1; c < log.getColumns().size(); c++)
+            names.push_back(to_string(c));
+        addColumns(log, "0", names);
+        return true;
+    }
+};
+
+/**
+ * Plays a logged trial back in the GUI, without running the simulation: the world is built
+ * from the configuration as for the trial, but only its robots' and pucks' positions,
+ * headings and states are set, from the logged robotPose, robotState and puckPosition
+ * streams (the .dat or .trj files, or the binary log).  No physics, sensing or control is
+ * run.  Between logged steps positions and headings are interpolated, and states and the
+ * evaluation are those last logged.
+ *
+ * Playback runs at a number of steps per second, from renderSteps steps per frame at 60
+ * frames per second to start with.  Keys: Space pauses, Up / Down double or halve the
+ * speed, Left / Right pause and step to the previous or next logged step, Page Up / Page
+ * Down seek back or forward a tenth of the trial, Home / End seek to the start or end,
+ * and I toggles the interpolation.  The GUI's own keys work as usual.
+ */
+class ReplayViewer : public KeyboardCallback
+{
+    Config m_config;
+    string m_dataDir;
+    int m_trialIndex;
+    ReplayTrack m_poses, m_states, m_pucks, m_stats;
+
+    shared_ptr<World> m_world;
+    shared_ptr<Simulator> m_sim;
+    shared_ptr<GUI> m_gui;
+
+    double m_step = 0;
+    double m_speed;                 // steps per second
+    bool m_paused = false;
+    bool m_interpolate = true;
+
+    string streamFilename(const string & stream, const string & extension) const
+    {
+        return m_dataDir + "/" + stream + "_" + to_string(m_trialIndex) + extension;
+    }
+
+    static double lerp(double a, double b, double f)
+    {
+        return a + (b - a) * f;
+    }
+
+    // Set the positions (and velocities, for the GUI's velocity lines) of the entities
+    // from a track of x, y[, angle] groups at the current step.
+    void applyPositions(const ReplayTrack & track, vector<Entity> & entities, size_t group)
+    {
+        if (track.empty())
+            return;
+        size_t i = track.rowAt(m_step);
+        size_t j = min(i + 1, track.steps.size() - 1);
+        double span = track.steps[j] - track.steps[i];
+        double f = span > 0 ? min(max((m_step - track.steps[i]) / span, 0.0), 1.0) : 0;
+        if (!m_interpolate)
+            f = 0;
+        const double * a = track.row(i);
+        const double * b = track.row(j);
+
+        size_t n = min(entities.size(), track.width / group);
+        for (size_t e = 0; e < n; e++) {
+            const double * p = a + e * group;
+            const double * q = b + e * group;
+            if (isnan(p[0]) || isnan(p[1]))
+                continue;
+            auto & t = entities[e].getComponent<CTransform>();
+            t.p = Vec2(lerp(p[0], q[0], f), lerp(p[1], q[1], f));
+            t.v = span > 0 ? Vec2((q[0] - p[0]) / span, (q[1] - p[1]) / span) : Vec2(0, 0);
+            if (group == 3 && entities[e].hasComponent<CSteer>())
+                entities[e].getComponent<CSteer>().angle = p[2] + remainder(q[2] - p[2], 2 * M_PI) * f;
+        }
+    }
+
+    void applyStates(vector<Entity> & robots)
+    {
+        if (m_states.empty())
+            return;
+        const double * row = m_states.row(m_states.rowAt(m_step));
+        for (size_t r = 0; r < min(robots.size(), m_states.width); r++) {
+            if (isnan(row[r]))
+                continue;
+            State state = (State)(int)row[r];
+            robots[r].getComponent<CColor>() = toColor(state);
+        }
+    }
+
+    double firstStep() const
+    {
+        return m_poses.steps.front();
+    }
+
+    double lastStep() const
+    {
+        return m_poses.steps.back();
+    }
+
+    // Move to the next (+1) or previous (-1) logged pose.
+    void stepRow(int direction)
+    {
+        m_paused = true;
+        size_t i = m_poses.rowAt(m_step);
+        if (direction < 0 && m_poses.steps[i] == m_step && i > 0)
+            m_step = m_poses.steps[i - 1];
+        else if (direction < 0)
+            m_step = m_poses.steps[i];
+        else if (i + 1 < m_poses.steps.size())
+            m_step = m_poses.steps[i + 1];
+    }
+
+    void seek(double step)
+    {
+        m_step = min(max(step, firstStep()), lastStep());
+    }
+
+    string status() const
+    {
+        ostringstream status;
+        status << "Replay of " << m_dataDir << " trial " << m_trialIndex << "\n";
+        status << "step " << (size_t)m_step << " of " << (size_t)lastStep() << "   " << m_speed << " steps/s";
+        if (m_paused)
+            status << " (paused)";
+        if (!m_interpolate)
+            status << " (no interpolation)";
+        status << "\n";
+        if (!m_stats.empty())
+            status << "eval " << m_stats.row(m_stats.rowAt(m_step))[0] << "\n";
+        return status.str();
+    }
+
+public:
+    ReplayViewer(const Config & config, const string & dataDir, int trialIndex)
+        : m_config(config)
+        , m_dataDir(dataDir)
+        , m_trialIndex(trialIndex)
+        , m_speed(60 * max(config.renderSteps, 1.0))
+    {
+    }
+
+    /**
+     * Read the trial's logs: the binary log if there is one, else the text streams (a
+     * compressed trajectory in place of a .dat file if there is one).  False if there are
+     * no poses to play.
+     */
+    bool load()
+    {
+        LogReader binary(streamFilename("log", ".bin"));
+        if (binary.good()) {
+            vector<string> poses, states, pucks;
+            for (size_t i = 0; binary.getColumn("robot" + to_string(i) + ".x"); i++) {
+                string prefix = "robot" + to_string(i) + ".";
+                poses.insert(poses.end(), { prefix + "x", prefix + "y", prefix + "angle" });
+                states.push_back(prefix + "state");
+            }
+            for (size_t i = 0; binary.getColumn("puck" + to_string(i) + ".x"); i++)
+                pucks.insert(pucks.end(), { "puck" + to_string(i) + ".x", "puck" + to_string(i) + ".y" });
+            m_poses.addColumns(binary, "step", poses);
+            if (binary.getColumn("robot0.state"))
+                m_states.addColumns(binary, "step", states);
+            m_pucks.addColumns(binary, "step", pucks);
+            if (binary.getColumn("eval"))
+                m_stats.addColumns(binary, "step", { "eval" });
+        } else {
+            if (!m_poses.load(streamFilename("robotPose", ".trj")))
+                m_poses.load(streamFilename("robotPose", ".dat"));
+            if (!m_pucks.load(streamFilename("puckPosition", ".trj")))
+                m_pucks.load(streamFilename("puckPosition", ".dat"));
+            m_states.load(streamFilename("robotState", ".dat"));
+
+            // Of the stats, just the evaluation, the first value of each line.
+            LogReader stats(streamFilename("stats", ".dat"));
+            if (stats.good())
+                m_stats.addColumns(stats, "0", { "1" });
+        }
+
+        if (m_poses.empty()) {
+            cerr << "No robot poses logged for trial " << m_trialIndex << " in " << m_dataDir << endl;
+            return false;
+        }
+        return true;
+    }
+
+    void keyHandler(sf::Keyboard::Key key)
+    {
+        double jump = (lastStep() - firstStep()) / 10;
+        switch (key) {
+        case sf::Keyboard::Space:
+            m_paused = !m_paused;
+            break;
+        case sf::Keyboard::Up:
+            m_speed *= 2;
+            break;
+        case sf::Keyboard::Down:
+            m_speed = max(m_speed / 2, 1.0);
+            break;
+        case sf::Keyboard::Left:
+            stepRow(-1);
+            break;
+        case sf::Keyboard::Right:
+            stepRow(1);
+            break;
+        case sf::Keyboard::PageUp:
+            seek(m_step - jump);
+            break;
+        case sf::Keyboard::PageDown:
+            seek(m_step + jump);
+            break;
+        case sf::Keyboard::Home:
+            seek(firstStep());
+            break;
+        case sf::Keyboard::End:
+            seek(lastStep());
+            break;
+        case sf::Keyboard::I:
+            m_interpolate = !m_interpolate;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Play the trial from the given step until the window is closed or a stop is requested.
+    int run(double fromStep)
+    {
+        default_random_engine rng(m_trialIndex + 1);
+        m_world = lasso_world::GetWorld(rng, m_config);
+        m_sim = make_shared<Simulator>(m_world);
+        // Drawing is all there is to do, so the GUI's frame rate paces the loop.
+        m_gui = make_shared<GUI>(m_sim, 60);
+        m_gui->setKeyboardCallback(this);
+
+        auto & robots = m_world->getEntities("robot");
+        auto & pucks = m_world->getEntities("red_puck");
+        if (robots.size() != m_poses.width / 3 || (!m_pucks.empty() && pucks.size() != m_pucks.width / 2))
+            cerr << "Warning: the world has " << robots.size() << " robots and " << pucks.size() << " pucks, the log "
+                 << m_poses.width / 3 << " and " << m_pucks.width / 2 << endl;
+
+        seek(fromStep);
+        sf::Clock clock;
+        while (!StopRequested()) {
+            double elapsed = clock.restart().asSeconds();
+            if (!m_paused) {
+                m_step += m_speed * elapsed;
+                if (m_step >= lastStep()) {
+                    m_step = lastStep();
+                    m_paused = true;
+                }
+            }
+
+            applyPositions(m_poses, robots, 3);
+            applyPositions(m_pucks, pucks, 2);
+            applyStates(robots);
+            m_gui->setStatus(status());
+            m_gui->update();
+        }
+        m_gui->close();
+        return 0;
+    }
+};
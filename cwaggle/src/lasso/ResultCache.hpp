@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// For mkdir, rename and getpid
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "Config.hpp"
+#include "DataLogger.hpp"
+#include "TrialResult.hpp"
+
+// Identifies the simulator code in cache keys, so that results computed by an older build
+// are never reused.  The Makefile sets this from git; untracked builds share "unknown".
+#ifndef CWAGGLE_CODE_VERSION
+#define CWAGGLE_CODE_VERSION "unknown"
+#endif
+
+using namespace std;
+
+/**
+ * A content-addressed store of trial results.  Each entry is keyed by a hash of the
+ * effective configuration, the seed and the code version, and holds the trial's summary
+ * plus a copy of its logs:
+ *
+ *   <resultCacheDir>/<key>/key.txt        the text that was hashed
+ *   <resultCacheDir>/<key>/summary.txt    the TrialResult
+ *   <resultCacheDir>/<key>/stepStats.dat  its stepStats, if aggregateSkip was set
+ *   <resultCacheDir>/<key>/robotOccupancy.txt, puckDensity.txt  its heatmaps, if heatmapSkip was set
+ *   <resultCacheDir>/<key>/stats.dat      ...and the other streams, if logging was on
+ *
+ * Entries are written to a temporary directory and renamed into place, so concurrent
+ * sweeps sharing a cache never see a partial entry.
+ */
+class ResultCache
+{
+    string m_dir;
+
+    static bool copyFile(const string & from, const string & to)
+    {
+        ifstream in(from, ios::binary);
+        if (!in)
+            return false;
+        ofstream out(to, ios::binary);
+        out << in.rdbuf();
+        return out.good();
+    }
+
+    static void removeEntryDir(const string & dir, const Config & config)
+    {
+        remove((dir + "/key.txt").c_str());
+        remove((dir + "/summary.txt").c_str());
+        remove((dir + "/stepStats.dat").c_str());
+        remove((dir + "/replay.txt").c_str());
+        remove((dir + "/robotOccupancy.txt").c_str());
+        remove((dir + "/puckDensity.txt").c_str());
+        for (auto & stream : DataLogger::getStreamNames(config))
+            remove((dir + "/" + stream + ".dat").c_str());
+        rmdir(dir.c_str());
+    }
+
+public:
+    ResultCache(const string & dir)
+        : m_dir(dir)
+    {
+    }
+
+    bool enabled() const
+    {
+        return !m_dir.empty();
+    }
+
+    /**
+     * The text identifying a trial.  Parameters that only control presentation or where
+     * output goes are reset first, since they cannot change the result.
+     */
+    static string getKeyText(Config config, int rngSeed)
+    {
+        Config defaults;
+        config.gui = defaults.gui;
+        config.renderThread = defaults.renderThread;
+        config.captureScreenshots = defaults.captureScreenshots;
+        config.screenshotFilenameBase = defaults.screenshotFilenameBase;
+        config.videoFilenameBase = defaults.videoFilenameBase;
+        config.videoFormat = defaults.videoFormat;
+        config.videoFrameRate = defaults.videoFrameRate;
+        config.dataFilenameBase = defaults.dataFilenameBase;
+        config.numTrials = defaults.numTrials;
+        config.arenaSweep = defaults.arenaSweep;
+        config.paramSweep = defaults.paramSweep;
+        config.resultCacheDir = defaults.resultCacheDir;
+        config.trialTimeBudget = defaults.trialTimeBudget;
+        config.sweepTimeBudget = defaults.sweepTimeBudget;
+        config.sweepStepBudget = defaults.sweepStepBudget;
+        config.sweepManifest = defaults.sweepManifest;
+        config.flightRecorderSteps = defaults.flightRecorderSteps;
+        config.liveTelemetrySocket = defaults.liveTelemetrySocket;
+        config.liveTelemetrySkip = defaults.liveTelemetrySkip;
+        config.livePoseSkip = defaults.livePoseSkip;
+
+        ostringstream oss;
+        oss << "codeVersion " << CWAGGLE_CODE_VERSION << "\n";
+        oss << "rngSeed " << rngSeed << "\n";
+        config.save(oss);
+        return oss.str();
+    }
+
+    // 64-bit FNV-1a, written as 16 hex digits.
+    static string hash(const string & text)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (unsigned char c : text) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        ostringstream oss;
+        oss << hex << setw(16) << setfill('0') << h;
+        return oss.str();
+    }
+
+    /**
+     * Look up the given trial.  On a hit, the cached logs are copied to where the trial
+     * would have written them, and 'result' is filled in for the given trial index.
+     */
+    bool lookup(const Config & config, int trialIndex, int rngSeed, TrialResult & result)
+    {
+        string keyText = getKeyText(config, rngSeed);
+        string entry = m_dir + "/" + hash(keyText);
+
+        ifstream keyIn(entry + "/key.txt");
+        stringstream storedKey;
+        storedKey << keyIn.rdbuf();
+        if (!keyIn || storedKey.str() != keyText)
+            return false;
+
+        ifstream summaryIn(entry + "/summary.txt");
+        if (!result.load(summaryIn))
+            return false;
+        result.trialIndex = trialIndex;
+        result.cached = true;
+
+        ifstream replayIn(entry + "/replay.txt");
+        if (replayIn) {
+            stringstream replay;
+            replay << replayIn.rdbuf();
+            result.replayRecord = replay.str();
+        }
+
+        ifstream statsIn(entry + "/stepStats.dat");
+        string line;
+        while (getline(statsIn, line)) {
+            istringstream iss(line);
+            vector<double> row;
+            double value;
+            while (iss >> value)
+                row.push_back(value);
+            result.stepStats.push_back(row);
+        }
+
+        if (config.heatmapSkip) {
+            ifstream robotsIn(entry + "/robotOccupancy.txt"), pucksIn(entry + "/puckDensity.txt");
+            if (!result.robotOccupancy.load(robotsIn) || !result.puckDensity.load(pucksIn))
+                return false;
+        }
+
+        if (config.writeDataSkip && DataLogger::isArchived(config)) {
+            for (auto & stream : DataLogger::getStreamNames(config)) {
+                stringstream data;
+                ifstream in(entry + "/" + stream + ".dat", ios::binary);
+                data << in.rdbuf();
+                if (!in || !SweepArchive::append(config.archiveFile, config.dataFilenameBase, trialIndex,
+                                                 stream + DataLogger::getExtension(config, stream), data.str()))
+                    return false;
+            }
+        } else if (config.writeDataSkip) {
+            if (mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+                cerr << "Error creating directory: " << config.dataFilenameBase << endl;
+            for (auto & stream : DataLogger::getStreamNames(config)) {
+                if (!copyFile(entry + "/" + stream + ".dat", DataLogger::getFilename(config, stream, trialIndex)))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void store(const Config & config, const TrialResult & result)
+    {
+        string keyText = getKeyText(config, result.rngSeed);
+        string entry = m_dir + "/" + hash(keyText);
+
+        ostringstream tmp;
+        tmp << entry << ".tmp" << getpid();
+        string tmpEntry = tmp.str();
+
+        if (mkdir(m_dir.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << m_dir << endl;
+        if (mkdir(tmpEntry.c_str(), 0777) == -1) {
+            cerr << "Error creating cache entry: " << tmpEntry << endl;
+            return;
+        }
+
+        ofstream(tmpEntry + "/key.txt") << keyText;
+        ofstream summaryOut(tmpEntry + "/summary.txt");
+        result.save(summaryOut);
+        summaryOut.close();
+
+        if (!result.replayRecord.empty()) {
+            ofstream replayOut(tmpEntry + "/replay.txt");
+            replayOut << result.replayRecord;
+        }
+
+        if (!result.stepStats.empty()) {
+            ofstream statsOut(tmpEntry + "/stepStats.dat");
+            statsOut.precision(17);
+            for (auto & row : result.stepStats) {
+                for (size_t i = 0; i < row.size(); i++)
+                    statsOut << (i > 0 ? " " : "") << row[i];
+                statsOut << "\n";
+            }
+        }
+
+        if (config.heatmapSkip) {
+            ofstream robotsOut(tmpEntry + "/robotOccupancy.txt"), pucksOut(tmpEntry + "/puckDensity.txt");
+            result.robotOccupancy.save(robotsOut);
+            result.puckDensity.save(pucksOut);
+        }
+
+        if (config.writeDataSkip && DataLogger::isArchived(config)) {
+            vector<SweepArchive::Entry> entries = SweepArchive::readIndex(config.archiveFile);
+            for (auto & stream : DataLogger::getStreamNames(config)) {
+                string data;
+                if (SweepArchive::readStream(config.archiveFile, entries, config.dataFilenameBase, result.trialIndex, stream + DataLogger::getExtension(config, stream), data))
+                    ofstream(tmpEntry + "/" + stream + ".dat", ios::binary) << data;
+            }
+        } else if (config.writeDataSkip) {
+            for (auto & stream : DataLogger::getStreamNames(config))
+                copyFile(DataLogger::getFilename(config, stream, result.trialIndex), tmpEntry + "/" + stream + ".dat");
+        }
+
+        // If another process stored the same entry first, theirs is kept.
+        if (rename(tmpEntry.c_str(), entry.c_str()) != 0)
+            removeEntryDir(tmpEntry, config);
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For mkdir and getpid
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "Config.hpp"
+#include "OnlineStats.hpp"
+
+using namespace std;
+
+/**
+ * Per-step statistics across the trials of one condition, accumulated as each trial
+ * finishes.  Every aggregateSkip steps a trial contributes one row holding the columns of
+ * a stats_<trial>.dat line; for each step and column the aggregator keeps a RunningStats
+ * (mean and standard deviation) and a TDigest (quantiles).  The result is written to
+ * <dataFilenameBase>/summary.dat, a space-separated table with a header line:
+ *
+ *   step n eval_mean eval_std eval_q05 eval_q25 eval_q50 eval_q75 eval_q95 propSlowed_mean ...
+ *
+ * Trials of different lengths are fine; 'n' counts the trials that reached each step.
+ */
+class StatsAggregator
+{
+public:
+    // The columns of a row after the step, as in the stats_<trial>.dat files.
+    static const vector<string> & getColumnNames()
+    {
+        static const vector<string> names{ "eval", "propSlowed", "cumPropSlowed", "avgTau", "avgMedianTau", "avgFilteredTau", "avgState" };
+        return names;
+    }
+
+private:
+    struct Column
+    {
+        RunningStats stats;
+        TDigest digest;
+    };
+
+    string m_filename;
+    map<long long, vector<Column>> m_steps;
+    size_t m_trials = 0;
+
+public:
+    StatsAggregator(const Config & config)
+        : m_filename(config.dataFilenameBase + "/summary.dat")
+    {
+    }
+
+    size_t getNumTrials() const
+    {
+        return m_trials;
+    }
+
+    // Add a trial's rows, each holding the step followed by the values of getColumnNames().
+    void addTrial(const vector<vector<double>> & rows)
+    {
+        for (auto & row : rows) {
+            vector<Column> & columns = m_steps[(long long)row[0]];
+            columns.resize(getColumnNames().size());
+            for (size_t c = 0; c < columns.size() && c + 1 < row.size(); c++) {
+                columns[c].stats.add(row[c + 1]);
+                columns[c].digest.add(row[c + 1]);
+            }
+        }
+        m_trials++;
+    }
+
+    /**
+     * Write the summary.  The file is replaced atomically, so it can be rewritten after
+     * every trial and is never seen half-written.
+     */
+    void write()
+    {
+        size_t slash = m_filename.rfind('/');
+        string dir = m_filename.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << dir << endl;
+
+        static const vector<pair<string, double>> quantiles{ { "q05", 0.05 }, { "q25", 0.25 }, { "q50", 0.5 }, { "q75", 0.75 }, { "q95", 0.95 } };
+
+        ostringstream tmp;
+        tmp << m_filename << ".tmp" << getpid();
+        ofstream fout(tmp.str());
+        fout << "step n";
+        for (auto & name : getColumnNames()) {
+            fout << " " << name << "_mean " << name << "_std";
+            for (auto & q : quantiles)
+                fout << " " << name << "_" << q.first;
+        }
+        fout << "\n";
+
+        for (auto & step : m_steps) {
+            fout << step.first << " " << step.second[0].stats.count();
+            for (auto & column : step.second) {
+                fout << " " << column.stats.mean() << " " << column.stats.stddev();
+                for (auto & q : quantiles)
+                    fout << " " << column.digest.quantile(q.second);
+            }
+            fout << "\n";
+        }
+        fout.close();
+
+        if (!fout || rename(tmp.str().c_str(), m_filename.c_str()) != 0) {
+            cerr << "Error writing summary: " << m_filename << endl;
+            remove(tmp.str().c_str());
+        }
+    }
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// For open, flock, write and close
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * An append-only archive holding the logs of a whole sweep in one file, instead of a
+ * directory tree of small per-trial files.  Each entry is one stream of one trial of one
+ * condition (the dataFilenameBase the trial would otherwise have written to):
+ *
+ *   entry:   "CWAR"  uint32 keyLength  uint64 dataLength  key  data
+ *   key:     condition '\t' trial '\t' stream
+ *
+ * with integers little-endian.  Alongside, <archive>.idx has a text line per entry,
+ *
+ *   dataOffset dataLength trial stream condition
+ *
+ * so entries can be found without reading the archive.  Writers take an exclusive flock
+ * on the archive while appending an entry and its index line, so any number of processes
+ * may append to the same archive.  If an entry is written twice (e.g. a trial that was
+ * interrupted and then re-run), the later one is the one that counts.  The index can be
+ * rebuilt from the archive alone with scan().
+ *
+ * A long stream may be appended in segments as it is written (see SegmentBuffer): the
+ * first under the stream's name, then "<stream>#1", "<stream>#2" and so on.  Reading a
+ * stream (readStream) joins its latest first segment with the segments after it.
+ */
+namespace SweepArchive
+{
+    struct Entry
+    {
+        string condition;
+        int trial = 0;
+        string stream;
+        uint64_t offset = 0;
+        uint64_t length = 0;
+    };
+
+    inline bool writeAll(int fd, const char * data, size_t size)
+    {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    inline bool append(const string & archive, const string & condition, int trial, const string & stream, const string & data)
+    {
+        int fd = open(archive.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+        int idx = open((archive + ".idx").c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+        if (fd < 0 || idx < 0 || flock(fd, LOCK_EX) != 0) {
+            cerr << "Error opening archive " << archive << ": " << strerror(errno) << endl;
+            if (fd >= 0)
+                close(fd);
+            if (idx >= 0)
+                close(idx);
+            return false;
+        }
+
+        string key = condition + "\t" + to_string(trial) + "\t" + stream;
+        string header = "CWAR";
+        for (int i = 0; i < 4; i++)
+            header.push_back((char)(key.size() >> (8 * i)));
+        for (int i = 0; i < 8; i++)
+            header.push_back((char)((uint64_t)data.size() >> (8 * i)));
+        header += key;
+
+        // With the lock held nobody else appends, so the entry lands at the current end.
+        off_t start = lseek(fd, 0, SEEK_END);
+        ostringstream line;
+        line << start + header.size() << " " << data.size() << " " << trial << " " << stream << " " << condition << "\n";
+
+        bool ok = start >= 0 && writeAll(fd, header.data(), header.size()) && writeAll(fd, data.data(), data.size())
+            && writeAll(idx, line.str().data(), line.str().size());
+        if (!ok)
+            cerr << "Error appending to archive " << archive << ": " << strerror(errno) << endl;
+
+        flock(fd, LOCK_UN);
+        close(idx);
+        close(fd);
+        return ok;
+    }
+
+    // Read the entries listed in the index, oldest first.
+    inline vector<Entry> readIndex(const string & archive)
+    {
+        vector<Entry> entries;
+        ifstream fin(archive + ".idx");
+        string line;
+        while (getline(fin, line)) {
+            istringstream iss(line);
+            Entry e;
+            if (!(iss >> e.offset >> e.length >> e.trial >> e.stream))
+                continue;
+            iss.get();
+            getline(iss, e.condition);
+            entries.push_back(e);
+        }
+        return entries;
+    }
+
+    // Recover the entries by walking the archive itself, stopping at a truncated entry.
+    inline vector<Entry> scan(const string & archive)
+    {
+        vector<Entry> entries;
+        ifstream fin(archive, ios::binary | ios::ate);
+        uint64_t size = fin ? (uint64_t)fin.tellg() : 0;
+        fin.seekg(0);
+
+        char header[16];
+        while (fin.read(header, 16) && memcmp(header, "CWAR", 4) == 0) {
+            uint64_t keyLength = 0, length = 0;
+            for (int i = 0; i < 4; i++)
+                keyLength |= (uint64_t)(unsigned char)header[4 + i] << (8 * i);
+            for (int i = 0; i < 8; i++)
+                length |= (uint64_t)(unsigned char)header[8 + i] << (8 * i);
+
+            string key(keyLength, '\0');
+            if (!fin.read(&key[0], keyLength))
+                break;
+
+            Entry e;
+            size_t tab1 = key.find('\t'), tab2 = key.rfind('\t');
+            e.condition = key.substr(0, tab1);
+            e.trial = atoi(key.substr(tab1 + 1, tab2 - tab1 - 1).c_str());
+            e.stream = key.substr(tab2 + 1);
+            e.offset = (uint64_t)fin.tellg();
+            e.length = length;
+            if (e.offset + length > size)
+                break;
+            entries.push_back(e);
+            fin.seekg(e.offset + length);
+        }
+        return entries;
+    }
+
+    // The name of the n'th segment of a stream.
+    inline string segmentName(const string & stream, size_t n)
+    {
+        return n == 0 ? stream : stream + "#" + to_string(n);
+    }
+
+    inline bool matches(const Entry & e, const string & condition, int trial, const string & stream)
+    {
+        return e.trial == trial && e.stream == stream && e.condition == condition;
+    }
+
+    /**
+     * The entries holding a stream, in order: the latest entry under its name, and then
+     * the segments appended after that one.  Empty if there is no such stream.
+     */
+    inline vector<Entry> findSegments(const vector<Entry> & entries, const string & condition, int trial, const string & stream)
+    {
+        vector<Entry> segments;
+        size_t first = entries.size();
+        for (size_t i = entries.size(); i-- > 0; ) {
+            if (matches(entries[i], condition, trial, stream)) {
+                first = i;
+                break;
+            }
+        }
+        if (first == entries.size())
+            return segments;
+        segments.push_back(entries[first]);
+        for (size_t i = first + 1; i < entries.size(); i++) {
+            if (matches(entries[i], condition, trial, segmentName(stream, segments.size())))
+                segments.push_back(entries[i]);
+        }
+        return segments;
+    }
+
+    inline bool read(const string & archive, const Entry & entry, string & data)
+    {
+        ifstream fin(archive, ios::binary);
+        data.resize(entry.length);
+        fin.seekg(entry.offset);
+        return (bool)fin.read(&data[0], entry.length);
+    }
+
+    // Read a whole stream, joining its segments.
+    inline bool readStream(const string & archive, const vector<Entry> & entries, const string & condition, int trial, const string & stream, string & data)
+    {
+        vector<Entry> segments = findSegments(entries, condition, trial, stream);
+        if (segments.empty())
+            return false;
+        data.clear();
+        string segment;
+        for (auto & e : segments) {
+            if (!read(archive, e, segment))
+                return false;
+            data += segment;
+        }
+        return true;
+    }
+
+    /**
+     * A stream buffer that appends what is written to it to an archive in segments of
+     * segmentBytes, so that memory stays bounded however long the stream, and a process
+     * that dies leaves all but its last segment in the archive.  The last segment is
+     * appended by close(), or on destruction.
+     */
+    class SegmentBuffer : public streambuf
+    {
+        string m_archive, m_condition, m_stream;
+        int m_trial;
+        vector<char> m_buffer;
+        size_t m_segments = 0;
+        bool m_closed = false;
+
+        void appendSegment()
+        {
+            size_t n = pptr() - pbase();
+            if (n > 0 || m_segments == 0)
+                append(m_archive, m_condition, m_trial, segmentName(m_stream, m_segments++), string(pbase(), n));
+            setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        }
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            appendSegment();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+    public:
+        SegmentBuffer(const string & archive, const string & condition, int trial, const string & stream, size_t segmentBytes)
+            : m_archive(archive)
+            , m_condition(condition)
+            , m_stream(stream)
+            , m_trial(trial)
+            , m_buffer(max(segmentBytes, (size_t)1))
+        {
+            setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        }
+
+        ~SegmentBuffer()
+        {
+            close();
+        }
+
+        void close()
+        {
+            if (!m_closed)
+                appendSegment();
+            m_closed = true;
+        }
+    };
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For mkdir, getpid, open and fsync
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "Config.hpp"
+#include "ResultCache.hpp"
+#include "TrialResult.hpp"
+
+using namespace std;
+
+/**
+ * The record of which trials of one condition (i.e. one dataFilenameBase) have completed,
+ * kept in <dataFilenameBase>/manifest.txt so that an interrupted sweep can resume.  The
+ * file holds the key of the configuration, then a block per completed trial:
+ *
+ *   key <hash>
+ *   trialIndex rngSeed eval cumPropSlowed steps aborted truncated
+ *   stats trialIndex step eval propSlowed ...
+ *   end trialIndex
+ *
+ * The "stats" lines hold the trial's stepStats, so that a resumed sweep can put the trials
+ * it skips back into summary.dat.  Each trial's block is appended (and synced) as the trial
+ * completes, and only a block with its "end" line counts, so a block cut short by a kill
+ * is ignored.  A manifest written for a different configuration (or build), or one that
+ * ends in a partial block, is replaced at the next record.
+ */
+class SweepManifest
+{
+    string m_filename;
+    string m_key;
+    map<int, TrialResult> m_trials;
+
+    // True until the file holds this manifest's key and whole blocks, so that it can be appended to.
+    bool m_rewrite = true;
+
+    static void writeTrial(ostream & out, const TrialResult & r)
+    {
+        out << r.trialIndex << " " << r.rngSeed << " " << r.eval << " " << r.cumPropSlowed << " "
+            << r.steps << " " << r.aborted << " " << r.truncated << "\n";
+        for (auto & row : r.stepStats) {
+            out << "stats " << r.trialIndex;
+            for (double value : row)
+                out << " " << value;
+            out << "\n";
+        }
+        out << "end " << r.trialIndex << "\n";
+    }
+
+    /**
+     * Write the whole manifest.  The new file is renamed into place, so a kill at any
+     * moment leaves either the old manifest or the new one.
+     */
+    void rewrite()
+    {
+        size_t slash = m_filename.rfind('/');
+        string dir = m_filename.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) == -1 && errno != EEXIST)
+            cerr << "Error creating directory: " << dir << endl;
+
+        ostringstream tmp;
+        tmp << m_filename << ".tmp" << getpid();
+        ofstream fout(tmp.str());
+        fout.precision(17);
+        fout << "key " << m_key << "\n";
+        for (auto & kv : m_trials)
+            writeTrial(fout, kv.second);
+        fout.close();
+
+        if (!fout || rename(tmp.str().c_str(), m_filename.c_str()) != 0) {
+            cerr << "Error writing manifest: " << m_filename << endl;
+            remove(tmp.str().c_str());
+            return;
+        }
+        m_rewrite = false;
+    }
+
+public:
+    SweepManifest(const Config & config)
+    {
+        if (!config.sweepManifest)
+            return;
+
+        m_filename = config.dataFilenameBase + "/manifest.txt";
+        m_key = ResultCache::hash(ResultCache::getKeyText(config, 0));
+
+        ifstream fin(m_filename);
+        string token, key;
+        if (!(fin >> token >> key) || token != "key")
+            return;
+        if (key != m_key) {
+            cerr << "Ignoring manifest for a different configuration: " << m_filename << endl;
+            return;
+        }
+
+        TrialResult block;
+        bool inBlock = false, complete = true;
+        string line;
+        while (getline(fin, line)) {
+            istringstream iss(line);
+            string word;
+            int trialIndex;
+            complete = !fin.eof();
+            if (line.compare(0, 6, "stats ") == 0) {
+                if (!(iss >> word >> trialIndex) || !inBlock || trialIndex != block.trialIndex)
+                    continue;
+                vector<double> row;
+                double value;
+                while (iss >> value)
+                    row.push_back(value);
+                block.stepStats.push_back(row);
+            } else if (line.compare(0, 4, "end ") == 0) {
+                if (iss >> word >> trialIndex && inBlock && trialIndex == block.trialIndex)
+                    m_trials[trialIndex] = block;
+                inBlock = false;
+            } else {
+                block = TrialResult();
+                inBlock = (bool)(iss >> block.trialIndex >> block.rngSeed >> block.eval >> block.cumPropSlowed
+                                    >> block.steps >> block.aborted >> block.truncated);
+            }
+        }
+        m_rewrite = inBlock || !complete;
+    }
+
+    bool enabled() const
+    {
+        return !m_filename.empty();
+    }
+
+    // Look up a completed trial, which must also have been run with the given seed.
+    bool lookup(int trialIndex, int rngSeed, TrialResult & result) const
+    {
+        auto it = m_trials.find(trialIndex);
+        if (it == m_trials.end() || it->second.rngSeed != rngSeed)
+            return false;
+        result = it->second;
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_trials.size();
+    }
+
+    // Add a completed trial, appending its block to the manifest.
+    void record(const TrialResult & result)
+    {
+        if (!enabled() || result.interrupted)
+            return;
+        m_trials[result.trialIndex] = result;
+        if (m_rewrite) {
+            rewrite();
+            return;
+        }
+
+        ostringstream block;
+        block.precision(17);
+        writeTrial(block, result);
+        string data = block.str();
+        int fd = open(m_filename.c_str(), O_WRONLY | O_APPEND);
+        bool written = fd >= 0 && write(fd, data.data(), data.size()) == (ssize_t)data.size() && fsync(fd) == 0;
+        if (fd >= 0)
+            close(fd);
+        if (!written) {
+            cerr << "Error appending to manifest: " << m_filename << endl;
+            rewrite();
+        }
+    }
+};
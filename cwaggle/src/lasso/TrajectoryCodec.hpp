@@ -0,0 +1,371 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Compressed trajectory streams (.trj files), used for the robotPose and puckPosition
+ * logs.  Each frame holds a step number and a fixed number of values, for instance x, y
+ * and angle per robot.  Values are quantised (each value has its own quantum), and every
+ * frame but the keyframes stores only the change from the previous frame.  The integers
+ * are zigzag encoded and written as LEB128 varints, so a robot that barely moved costs a
+ * byte or two per coordinate.
+ *
+ *   header:  "CWTRJ\0\0\0"  varint version  varint numValues  varint keyframeInterval
+ *            numValues quanta as little-endian float64
+ *   frame:   varint length (of the rest of the frame)  uint8 kind (0 = keyframe, 1 = delta)
+ *            zigzag step (absolute, or the change since the previous frame)
+ *            numValues zigzag values (absolute, or the change since the previous frame)
+ *   index:   varint length  uint8 kind (2)  varint count
+ *            count (zigzag step change, varint offset change) pairs, one per keyframe
+ *   trailer: uint64 offset of the index frame, little-endian  "CWTRJIDX"
+ *
+ * A keyframe is written every keyframeInterval frames, and the index of their steps and
+ * file offsets is written when the stream is closed, so a reader can seek to a step by
+ * looking it up and decoding from the keyframe before it.  A stream cut short by a killed
+ * run has no index; a reader then finds the keyframes once by hopping from frame to frame
+ * using the lengths.  Version 1 streams, which never have an index, are read the same way.
+ */
+namespace TrajectoryCodec
+{
+    static const uint64_t Version = 2;
+    static const uint8_t Keyframe = 0, Delta = 1, Index = 2;
+
+    inline void putVarint(vector<uint8_t> & out, uint64_t value)
+    {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    inline uint64_t zigzag(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value)
+    {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    // Read a varint from a stream, returning false at the end of the stream.
+    inline bool getVarint(istream & in, uint64_t & value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = in.get();
+            if (c == EOF)
+                return false;
+            value |= (uint64_t)(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Read a varint from a buffer, advancing 'pos'.
+    inline bool getVarint(const vector<uint8_t> & in, size_t & pos, uint64_t & value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+            uint8_t c = in[pos++];
+            value |= (uint64_t)(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+class TrajectoryEncoder
+{
+    ostream m_out;
+    vector<double> m_quanta;
+    size_t m_keyframeInterval;
+    size_t m_frames = 0;
+    int64_t m_previousStep = 0;
+    vector<int64_t> m_previous, m_current;
+    vector<uint8_t> m_body, m_frame;
+
+    // Where the keyframes are, for the index written on destruction.
+    uint64_t m_offset = 0;
+    vector<pair<int64_t, uint64_t>> m_keyframes;
+
+    void writeFrame()
+    {
+        m_frame.clear();
+        TrajectoryCodec::putVarint(m_frame, m_body.size());
+        m_out.write((const char *)m_frame.data(), m_frame.size());
+        m_out.write((const char *)m_body.data(), m_body.size());
+        m_offset += m_frame.size() + m_body.size();
+    }
+
+public:
+    // Write to the given buffer (a file, or memory for a SweepArchive), which must outlive this.
+    TrajectoryEncoder(streambuf * buffer, const vector<double> & quanta, size_t keyframeInterval)
+        : m_out(buffer)
+        , m_quanta(quanta)
+        , m_keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1)
+        , m_previous(quanta.size(), 0)
+        , m_current(quanta.size(), 0)
+    {
+        vector<uint8_t> header{ 'C', 'W', 'T', 'R', 'J', 0, 0, 0 };
+        TrajectoryCodec::putVarint(header, TrajectoryCodec::Version);
+        TrajectoryCodec::putVarint(header, quanta.size());
+        TrajectoryCodec::putVarint(header, m_keyframeInterval);
+        for (double q : quanta) {
+            uint64_t bits;
+            memcpy(&bits, &q, sizeof(bits));
+            for (int i = 0; i < 8; i++)
+                header.push_back((uint8_t)(bits >> (8 * i)));
+        }
+        m_out.write((const char *)header.data(), header.size());
+        m_offset = header.size();
+    }
+
+    // Close the stream with the keyframe index and the trailer that locates it.
+    ~TrajectoryEncoder()
+    {
+        uint64_t indexOffset = m_offset;
+        m_body.clear();
+        m_body.push_back(TrajectoryCodec::Index);
+        TrajectoryCodec::putVarint(m_body, m_keyframes.size());
+        int64_t step = 0;
+        uint64_t offset = 0;
+        for (auto & keyframe : m_keyframes) {
+            TrajectoryCodec::putVarint(m_body, TrajectoryCodec::zigzag(keyframe.first - step));
+            TrajectoryCodec::putVarint(m_body, keyframe.second - offset);
+            step = keyframe.first;
+            offset = keyframe.second;
+        }
+        writeFrame();
+
+        char trailer[16];
+        for (int i = 0; i < 8; i++)
+            trailer[i] = (char)(indexOffset >> (8 * i));
+        memcpy(trailer + 8, "CWTRJIDX", 8);
+        m_out.write(trailer, sizeof(trailer));
+        m_out.flush();
+    }
+
+    // Append a frame; 'values' must hold one value per quantum given to the constructor.
+    void append(int64_t step, const vector<double> & values)
+    {
+        bool keyframe = m_frames % m_keyframeInterval == 0;
+        for (size_t i = 0; i < m_quanta.size(); i++)
+            m_current[i] = (int64_t)llround((i < values.size() ? values[i] : 0) / m_quanta[i]);
+
+        if (keyframe)
+            m_keyframes.emplace_back(step, m_offset);
+
+        m_body.clear();
+        m_body.push_back(keyframe ? TrajectoryCodec::Keyframe : TrajectoryCodec::Delta);
+        TrajectoryCodec::putVarint(m_body, TrajectoryCodec::zigzag(keyframe ? step : step - m_previousStep));
+        for (size_t i = 0; i < m_current.size(); i++)
+            TrajectoryCodec::putVarint(m_body, TrajectoryCodec::zigzag(keyframe ? m_current[i] : m_current[i] - m_previous[i]));
+
+        writeFrame();
+
+        // A run that is killed loses at most the frames since the last keyframe.
+        if (keyframe)
+            m_out.flush();
+
+        m_previousStep = step;
+        m_previous.swap(m_current);
+        m_frames++;
+    }
+};
+
+/**
+ * Reads a .trj file one frame at a time, so files of any length are decoded in constant
+ * memory.  seek() positions the reader at the keyframe before a given step, found in the
+ * stream's index (or, without one, in a list built by one pass over the frame lengths).
+ */
+class TrajectoryDecoder
+{
+    ifstream m_in;
+    vector<double> m_quanta;
+    size_t m_keyframeInterval = 0;
+    streampos m_firstFrame;
+    bool m_good = false;
+    int64_t m_step = 0;
+    vector<int64_t> m_current;
+    vector<uint8_t> m_body;
+
+    // The step and file offset of every keyframe, once known.
+    vector<pair<int64_t, streamoff>> m_keyframes;
+    bool m_haveKeyframes = false;
+
+    // Read the next frame's kind and body, leaving the body in m_body.
+    bool readFrame(uint8_t & kind)
+    {
+        uint64_t length;
+        if (!TrajectoryCodec::getVarint(m_in, length) || length == 0)
+            return false;
+        m_body.resize(length);
+        if (!m_in.read((char *)m_body.data(), length))
+            return false;
+        kind = m_body[0];
+        return true;
+    }
+
+    // Load the index located by the trailer, if the stream was closed properly.
+    bool readIndex()
+    {
+        char trailer[16];
+        m_in.clear();
+        if (!m_in.seekg(-(streamoff)sizeof(trailer), ios::end) || !m_in.read(trailer, sizeof(trailer))
+                || memcmp(trailer + 8, "CWTRJIDX", 8) != 0)
+            return false;
+        uint64_t indexOffset = 0;
+        for (int i = 0; i < 8; i++)
+            indexOffset |= (uint64_t)(unsigned char)trailer[i] << (8 * i);
+
+        uint8_t kind;
+        uint64_t count, raw, delta;
+        size_t pos = 1;
+        if (!m_in.seekg((streamoff)indexOffset) || !readFrame(kind) || kind != TrajectoryCodec::Index
+                || !TrajectoryCodec::getVarint(m_body, pos, count))
+            return false;
+        int64_t step = 0;
+        uint64_t offset = 0;
+        m_keyframes.clear();
+        for (uint64_t i = 0; i < count; i++) {
+            if (!TrajectoryCodec::getVarint(m_body, pos, raw) || !TrajectoryCodec::getVarint(m_body, pos, delta))
+                return false;
+            step += TrajectoryCodec::unzigzag(raw);
+            offset += delta;
+            m_keyframes.emplace_back(step, (streamoff)offset);
+        }
+        return true;
+    }
+
+    // Without an index, find the keyframes by skipping over the other frames' bodies.
+    void scanKeyframes()
+    {
+        m_keyframes.clear();
+        m_in.clear();
+        m_in.seekg(m_firstFrame);
+        uint64_t length, raw;
+        for (;;) {
+            streamoff framePos = m_in.tellg();
+            if (!TrajectoryCodec::getVarint(m_in, length) || length == 0)
+                break;
+            streamoff bodyEnd = (streamoff)m_in.tellg() + (streamoff)length;
+            int kind = m_in.get();
+            if (kind == TrajectoryCodec::Index || kind == EOF)
+                break;
+            if (kind == TrajectoryCodec::Keyframe) {
+                if (!TrajectoryCodec::getVarint(m_in, raw))
+                    break;
+                m_keyframes.emplace_back(TrajectoryCodec::unzigzag(raw), framePos);
+            }
+            if (!m_in.seekg(bodyEnd))
+                break;
+        }
+    }
+
+public:
+    TrajectoryDecoder(const string & filename)
+        : m_in(filename, ios::binary)
+    {
+        char magic[8];
+        uint64_t version, numValues, interval;
+        if (!m_in.read(magic, 8) || memcmp(magic, "CWTRJ\0\0\0", 8) != 0)
+            return;
+        if (!TrajectoryCodec::getVarint(m_in, version) || version < 1 || version > TrajectoryCodec::Version)
+            return;
+        if (!TrajectoryCodec::getVarint(m_in, numValues) || !TrajectoryCodec::getVarint(m_in, interval))
+            return;
+
+        for (uint64_t i = 0; i < numValues; i++) {
+            unsigned char bytes[8];
+            if (!m_in.read((char *)bytes, 8))
+                return;
+            uint64_t bits = 0;
+            for (int b = 0; b < 8; b++)
+                bits |= (uint64_t)bytes[b] << (8 * b);
+            double q;
+            memcpy(&q, &bits, sizeof(q));
+            m_quanta.push_back(q);
+        }
+        m_keyframeInterval = interval;
+        m_current.assign(numValues, 0);
+        m_firstFrame = m_in.tellg();
+        m_good = true;
+    }
+
+    // False if the file is missing or is not a trajectory stream.
+    bool good() const
+    {
+        return m_good;
+    }
+
+    size_t numValues() const
+    {
+        return m_quanta.size();
+    }
+
+    const vector<double> & getQuanta() const
+    {
+        return m_quanta;
+    }
+
+    /**
+     * Decode the next frame.  Returns false at the end of the stream, including a final
+     * frame left incomplete by a killed run.
+     */
+    bool next(int64_t & step, vector<double> & values)
+    {
+        uint8_t kind;
+        if (!m_good || !readFrame(kind) || kind == TrajectoryCodec::Index)
+            return false;
+
+        size_t pos = 1;
+        uint64_t raw;
+        if (!TrajectoryCodec::getVarint(m_body, pos, raw))
+            return false;
+        m_step = kind == 0 ? TrajectoryCodec::unzigzag(raw) : m_step + TrajectoryCodec::unzigzag(raw);
+
+        values.resize(m_current.size());
+        for (size_t i = 0; i < m_current.size(); i++) {
+            if (!TrajectoryCodec::getVarint(m_body, pos, raw))
+                return false;
+            int64_t v = TrajectoryCodec::unzigzag(raw);
+            m_current[i] = kind == 0 ? v : m_current[i] + v;
+            values[i] = m_current[i] * m_quanta[i];
+        }
+        step = m_step;
+        return true;
+    }
+
+    /**
+     * Position the reader so that next() returns the last keyframe at or before 'step'
+     * (or the first frame), after which frames can be read forward to the step wanted.
+     */
+    void seek(int64_t step)
+    {
+        if (!m_good)
+            return;
+        if (!m_haveKeyframes) {
+            if (!readIndex())
+                scanKeyframes();
+            m_haveKeyframes = true;
+        }
+
+        auto after = upper_bound(m_keyframes.begin(), m_keyframes.end(), step,
+            [](int64_t s, const pair<int64_t, streamoff> & keyframe) { return s < keyframe.first; });
+        m_in.clear();
+        m_in.seekg(after == m_keyframes.begin() ? (streamoff)m_firstFrame : prev(after)->second);
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Heatmap.hpp"
+
+using namespace std;
+
+/**
+ * The summary of a single trial, i.e. one MyExperiment run with a particular seed.
+ */
+struct TrialResult
+{
+    int trialIndex = 0;
+    int rngSeed = 0;
+    double eval = 0;
+    double cumPropSlowed = 0;
+    int steps = 0;
+    bool aborted = false;
+
+    // Set when the result was restored from a ResultCache rather than simulated.
+    bool cached = false;
+
+    // Set when the trial was cut short by its own time budget (the result still counts),
+    // or interrupted by a stop signal or an exhausted sweep budget (it does not).
+    bool truncated = false;
+    bool interrupted = false;
+
+    // Every aggregateSkip steps, the step and the columns of a stats line (see StatsAggregator).
+    vector<vector<double>> stepStats;
+
+    // Sampled every heatmapSkip steps: where the robots and the pucks were.
+    Heatmap robotOccupancy, puckDensity;
+
+    // The trial's ReplayRecord as text, if config.replayDigestSkip is set.
+    string replayRecord;
+
+    // Written as "name value" lines, in the same style as lasso_config.txt.
+    void save(ostream & out) const
+    {
+        auto oldPrecision = out.precision(17);
+        out << "trialIndex " << trialIndex << "\n"
+            << "rngSeed " << rngSeed << "\n"
+            << "eval " << eval << "\n"
+            << "cumPropSlowed " << cumPropSlowed << "\n"
+            << "steps " << steps << "\n"
+            << "aborted " << aborted << "\n";
+        out.precision(oldPrecision);
+    }
+
+    bool load(istream & in)
+    {
+        string token;
+        int fieldsRead = 0;
+        while (in >> token) {
+            if (token == "trialIndex")          { in >> trialIndex; }
+            else if (token == "rngSeed")        { in >> rngSeed; }
+            else if (token == "eval")           { in >> eval; }
+            else if (token == "cumPropSlowed")  { in >> cumPropSlowed; }
+            else if (token == "steps")          { in >> steps; }
+            else if (token == "aborted")        { in >> aborted; }
+            else { continue; }
+            fieldsRead++;
+        }
+        return fieldsRead == 6;
+    }
+};
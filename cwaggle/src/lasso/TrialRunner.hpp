@@ -0,0 +1,225 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For mkdir
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "Budget.hpp"
+#include "Config.hpp"
+#include "MyExperiment.hpp"
+#include "ReplayRecord.hpp"
+#include "ResultCache.hpp"
+#include "TrialResult.hpp"
+
+using namespace std;
+
+// The name of a heatmap's file or archive stream, e.g. robotOccupancyDecayed_3.dat.
+string heatmapName(const Config & config, const string & map, bool decayed, int trialIndex)
+{
+    string name = map + (decayed ? "Decayed" : "");
+    if (DataLogger::isArchived(config))
+        return name + ".dat";
+    return config.dataFilenameBase + "/" + name + "_" + (trialIndex < 0 ? "mean" : to_string(trialIndex)) + ".dat";
+}
+
+/**
+ * Save a trial's heatmaps where its logs would go: robotOccupancy_<trial>.dat,
+ * puckDensity_<trial>.dat and their decayed versions (robotOccupancyDecayed_<trial>.dat...)
+ * in the data directory, or entries of the SweepArchive.  A trialIndex of -1 is for the
+ * means over a condition's trials, in files named with "mean" for the trial.
+ */
+void writeHeatmaps(const Config & config, int trialIndex, const Heatmap & robots, const Heatmap & pucks)
+{
+    if (!DataLogger::isArchived(config) && mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+        cerr << "Error creating directory: " << config.dataFilenameBase << endl;
+    for (bool decayed : { false, true }) {
+        for (auto & map : { make_pair("robotOccupancy", &robots), make_pair("puckDensity", &pucks) }) {
+            string name = heatmapName(config, map.first, decayed, trialIndex);
+            bool written;
+            if (DataLogger::isArchived(config)) {
+                ostringstream oss;
+                map.second->write(oss, decayed);
+                written = SweepArchive::append(config.archiveFile, config.dataFilenameBase, trialIndex, name, oss.str());
+            } else {
+                written = map.second->write(name, decayed);
+            }
+            if (!written)
+                cerr << "Error writing heatmap: " << name << endl;
+        }
+    }
+}
+
+// Read back the heatmaps saved by writeHeatmaps.  False if any is missing.
+bool readHeatmaps(const Config & config, int trialIndex, Heatmap & robots, Heatmap & pucks)
+{
+    vector<SweepArchive::Entry> entries;
+    if (DataLogger::isArchived(config))
+        entries = SweepArchive::readIndex(config.archiveFile);
+    for (auto & map : { make_pair("robotOccupancy", &robots), make_pair("puckDensity", &pucks) }) {
+        string grids[2];
+        for (bool decayed : { false, true }) {
+            string name = heatmapName(config, map.first, decayed, trialIndex);
+            if (DataLogger::isArchived(config)) {
+                if (!SweepArchive::readStream(config.archiveFile, entries, config.dataFilenameBase, trialIndex, name, grids[decayed]))
+                    return false;
+            } else {
+                ifstream fin(name);
+                stringstream grid;
+                grid << fin.rdbuf();
+                if (!fin)
+                    return false;
+                grids[decayed] = grid.str();
+            }
+        }
+        istringstream cumulativeIn(grids[0]), decayedIn(grids[1]);
+        if (!map.second->read(cumulativeIn, decayedIn, config.heatmapCellSize))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Run a single trial to completion and return its summary.  This is the one place that
+ * MyExperiment objects are created for headless runs, so that the command-line sweeps
+ * and the job server produce identical results for the same (config, seed) pair.
+ *
+ * If config.resultCacheDir is set, a trial that has been run before is not simulated
+ * again; its summary and logs are restored from the cache instead.
+ *
+ * The trial ends early if it exceeds config.trialTimeBudget (result.truncated), or if a
+ * stop signal arrives or the given sweep budget runs out (result.interrupted).  Steps run
+ * are charged to the sweep budget.
+ *
+ * With config.replayDigestSkip set, a ReplayRecord is written alongside the logs, and with
+ * config.heatmapSkip set, the heatmaps of a trial that was not interrupted.
+ */
+TrialResult runTrial(const Config & config, int trialIndex, int rngSeed, RunBudget * sweepBudget = nullptr)
+{
+    ResultCache cache(config.resultCacheDir);
+    TrialResult cached;
+    if (cache.enabled() && cache.lookup(config, trialIndex, rngSeed, cached)) {
+        ReplayRecord::write(config, cached);
+        if (config.heatmapSkip)
+            writeHeatmaps(config, trialIndex, cached.robotOccupancy, cached.puckDensity);
+        return cached;
+    }
+
+    TrialResult result;
+    result.trialIndex = trialIndex;
+    result.rngSeed = rngSeed;
+    {
+        RunBudget trialBudget(config.trialTimeBudget);
+        MyExperiment exp(config, trialIndex, rngSeed);
+        exp.setStopCheck([&](size_t steps) {
+            return trialBudget.shouldStop() || (sweepBudget && sweepBudget->exhausted(steps));
+        });
+        exp.run();
+        result.eval = exp.getEvaluation();
+        result.cumPropSlowed = exp.getCumPropSlowed();
+        result.steps = exp.getStepCount();
+        result.aborted = exp.wasAborted();
+        result.stepStats = move(exp.getStepStats());
+        result.robotOccupancy = exp.getRobotOccupancy();
+        result.puckDensity = exp.getPuckDensity();
+        if (exp.wasStopped()) {
+            result.interrupted = StopRequested() || (sweepBudget && sweepBudget->exhausted(result.steps));
+            result.truncated = !result.interrupted;
+            if (StopRequested())
+                exp.dumpFlightRecorder(g_stopSignal == SIGINT ? "SIGINT" : "SIGTERM");
+        }
+
+        if (config.replayDigestSkip && !result.interrupted) {
+            ReplayRecord record;
+            record.codeVersion = CWAGGLE_CODE_VERSION;
+            record.key = ResultCache::hash(ResultCache::getKeyText(config, rngSeed));
+            record.trialIndex = trialIndex;
+            record.rngSeed = rngSeed;
+            record.config = config;
+            record.digests = exp.getDigests();
+            record.steps = result.steps;
+            record.eval = result.eval;
+            ostringstream oss;
+            record.save(oss);
+            result.replayRecord = oss.str();
+            ReplayRecord::write(config, result);
+        }
+    }
+    if (sweepBudget)
+        sweepBudget->addSteps(result.steps);
+    if (config.heatmapSkip && !result.interrupted)
+        writeHeatmaps(config, trialIndex, result.robotOccupancy, result.puckDensity);
+
+    // The experiment has been destroyed by now, so its logs are complete.  Only trials
+    // that ran their full course are worth caching.
+    if (cache.enabled() && !result.truncated && !result.interrupted)
+        cache.store(config, result);
+    return result;
+}
+
+/**
+ * Re-simulate the trial of a replay record (see ReplayRecord.hpp) with every step logged
+ * from 'fromStep' to 'toStep' (0 for the end of the trial), into a directory named after
+ * the record (data/replay_3.txt gives data/replay_3/).  The recorded digests are checked
+ * along the way, and the replay stops at the first that differs.  Returns 0 if the replay
+ * matched the record, 2 if it diverged, and 1 if the record could not be read.
+ */
+int replayTrial(const string & filename, size_t fromStep, size_t toStep)
+{
+    ReplayRecord record;
+    ifstream fin(filename);
+    if (!record.load(fin)) {
+        cerr << "Error reading replay record: " << filename << endl;
+        return 1;
+    }
+    if (record.codeVersion != CWAGGLE_CODE_VERSION)
+        cerr << "Warning: recorded by code version " << record.codeVersion << ", replaying with " << CWAGGLE_CODE_VERSION << endl;
+    if (ResultCache::hash(ResultCache::getKeyText(record.config, record.rngSeed)) != record.key)
+        cerr << "Warning: the recorded configuration does not match its key" << endl;
+
+    Config config = record.config;
+    config.dataFilenameBase = filename.substr(0, filename.rfind('.'));
+    config.writeDataSkip = 1;
+    config.statsSkip = config.robotPoseSkip = config.robotStateSkip = config.puckPositionSkip = 0;
+    config.puckMovedThreshold = 0;
+    config.captureTriggers = "";
+    config.gui = 0;
+    config.captureScreenshots = 0;
+    config.videoFilenameBase = "";
+    config.resultCacheDir = "";
+    config.archiveFile = "";
+    config.aggregateSkip = 0;
+    config.trialTimeBudget = 0;
+    size_t endStep = toStep > 0 ? min(toStep + 1, record.steps) : record.steps;
+
+    MyExperiment exp(config, record.trialIndex, record.rngSeed);
+    exp.setLogStart(fromStep);
+    size_t checked = 0;
+    bool diverged = false;
+    exp.setStopCheck([&](size_t step) {
+        auto & digests = exp.getDigests();
+        for (; checked < digests.size() && checked < record.digests.size(); checked++) {
+            if (digests[checked] != record.digests[checked]) {
+                cerr << "Diverged by step " << digests[checked].first << ": digest " << hex << setfill('0')
+                     << setw(16) << digests[checked].second << ", recorded " << setw(16) << record.digests[checked].second
+                     << dec << setfill(' ') << endl;
+                diverged = true;
+                return true;
+            }
+        }
+        return step >= endStep || StopRequested();
+    });
+    exp.run();
+
+    if (!diverged && exp.getStepCount() == (int)record.steps && exp.getEvaluation() != record.eval) {
+        cerr << "Diverged: final evaluation " << exp.getEvaluation() << ", recorded " << record.eval << endl;
+        diverged = true;
+    }
+    cerr << "Replayed trial " << record.trialIndex << " to step " << exp.getStepCount() << " into " << config.dataFilenameBase
+         << ", " << checked << " digests checked" << (diverged ? ", DIVERGED" : "") << endl;
+    return diverged ? 2 : 0;
+}
@@ -11,23 +11,87 @@
 
 #include "CWaggle.h"
 #include "MyExperiment.hpp"
+#include "TrialRunner.hpp"
+#include "ReplayViewer.hpp"
+#include "SweepManifest.hpp"
+#include "StatsAggregator.hpp"
+#include "Budget.hpp"
+#include "JobServer.hpp"
+#include "Optimiser.hpp"
 
 using namespace std;
 
-double singleExperiment(Config config)
+double singleExperiment(Config config, RunBudget & budget)
 {
+    SweepManifest manifest(config);
+    StatsAggregator aggregator(config);
+    Heatmap robotOccupancy, puckDensity;
+    bool summaryComplete = true, heatmapsComplete = true;
     double avgEval = 0;
-    for (int i = 0; i < config.numTrials; i++) {
+    int completed = 0;
+    for (int i = 0; i < config.numTrials && !budget.shouldStop(); i++) {
         cerr << "Trial: " << i << "\n";
 
         // We use i + 1 for the RNG seed because seeds of 0 and 1 seem to generate the
         // same result.
-        MyExperiment exp(config, i, i + 1);
-        exp.run();
-        if (exp.wasAborted())
+        TrialResult result;
+        if (manifest.enabled() && manifest.lookup(i, i + 1, result)) {
+            cerr << "Trial already completed." << "\n";
+            // A manifest from before stepStats were recorded cannot rebuild summary.dat, and
+            // rewriting it from the remaining trials alone would lose the earlier ones.
+            if (config.aggregateSkip && summaryComplete && result.stepStats.empty()) {
+                cerr << "Resumed trial has no stats in the manifest; summary.dat is left as it was." << "\n";
+                summaryComplete = false;
+            }
+            if (config.aggregateSkip && summaryComplete)
+                aggregator.addTrial(result.stepStats);
+            // The resumed trial's own heatmaps are reloaded for the means.
+            if (config.heatmapSkip && heatmapsComplete) {
+                Heatmap robots, pucks;
+                if (readHeatmaps(config, i, robots, pucks)) {
+                    robotOccupancy.accumulate(robots);
+                    puckDensity.accumulate(pucks);
+                } else {
+                    cerr << "Resumed trial's heatmaps could not be read; the mean heatmaps are left as they were." << "\n";
+                    heatmapsComplete = false;
+                }
+            }
+        } else {
+            result = runTrial(config, i, i + 1, &budget);
+            if (result.interrupted) {
+                cerr << "Trial interrupted at step " << result.steps << "." << "\n";
+                break;
+            }
+            manifest.record(result);
+            if (config.aggregateSkip && summaryComplete) {
+                aggregator.addTrial(result.stepStats);
+                aggregator.write();
+            }
+            if (config.heatmapSkip) {
+                robotOccupancy.accumulate(result.robotOccupancy);
+                puckDensity.accumulate(result.puckDensity);
+            }
+        }
+
+        completed++;
+        if (result.cached)
+            cerr << "Trial restored from cache." << "\n";
+        if (result.truncated)
+            cerr << "Trial stopped by trialTimeBudget at step " << result.steps << "." << "\n";
+        if (result.aborted)
             cerr << "Trial aborted." << "\n";
         else
-            avgEval += exp.getEvaluation();
+            avgEval += result.eval;
+    }
+
+    if (config.heatmapSkip && heatmapsComplete && robotOccupancy.samples() > 0)
+        writeHeatmaps(config, -1, robotOccupancy, puckDensity);
+
+    // A partial sweep reports the average of the trials it completed.
+    if (completed < config.numTrials) {
+        double partialEval = completed > 0 ? avgEval / completed : 0;
+        cout << "\t" << partialEval << " (partial: " << completed << " of " << config.numTrials << " trials)" << endl;
+        return partialEval;
     }
 
     cout << "\t" << avgEval / config.numTrials << "\n";
@@ -35,7 +99,7 @@ double singleExperiment(Config config)
     return avgEval / config.numTrials;
 }
 
-void paramSweep(Config config)
+void paramSweep(Config config, RunBudget & budget)
 {
     // You should just configure the following four lines.
     using choiceType = size_t;
@@ -46,6 +110,9 @@ void paramSweep(Config config)
     string filenameBase = config.dataFilenameBase;
     vector<pair<choiceType, double>> sweepResults;
     for (choiceType choice : choices) {
+        if (budget.shouldStop())
+            break;
+
         ostringstream oss;
         oss << filenameBase << "/" << choiceName << "_" << choice;
         config.dataFilenameBase = oss.str();
@@ -53,7 +120,7 @@ void paramSweep(Config config)
         *choiceVariable = choice;
 
         cout << choiceName << ": " << choice << endl;
-        double avgEval = singleExperiment(config);
+        double avgEval = singleExperiment(config, budget);
         sweepResults.push_back(make_pair(choice, avgEval));
     }
 
@@ -74,50 +141,97 @@ void paramSweep(Config config)
     */
 }
 
-void runParamOrSingle(Config config)
+void runParamOrSingle(Config config, RunBudget & budget)
 {
     if (config.paramSweep)
-        paramSweep(config);
+        paramSweep(config, budget);
     else
-        singleExperiment(config);
+        singleExperiment(config, budget);
 }
 
-void arenaSweep(Config config)
+void arenaSweep(Config config, RunBudget & budget)
 {
     string choiceName = "arenaConfig";
     vector<string> arenas{ "sim_stadium_no_wall", "sim_stadium_one_wall", "sim_stadium_two_walls", "sim_stadium_three_walls" };
 
     string filenameBase = config.dataFilenameBase;
     for (string arena : arenas) {
+        if (budget.shouldStop())
+            break;
+
         ostringstream oss;
         oss << filenameBase << "/" << arena;
         config.dataFilenameBase = oss.str();
 
         config.arenaConfig = arena;
         cout << config.arenaConfig << endl;
-        if (mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
+        if (!DataLogger::isArchived(config) && mkdir(config.dataFilenameBase.c_str(), 0777) == -1 && errno != EEXIST)
             cerr << "Error creating directory: " << config.dataFilenameBase << endl;
 
-        runParamOrSingle(config);
+        runParamOrSingle(config, budget);
     }
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 1) {
-        cerr << "Usage\n\tcwaggle_lasso NO_ARGUMENTS_PLEASE" << endl;
+    // With no arguments we run the experiment described by lasso_config.txt.  Otherwise
+    // "--serve" runs as a job server on stdin/stdout, or on the given Unix socket path,
+    // "--optimise" tunes the parameters listed in optimParams, "--replay" re-runs a
+    // trial from its replay record, and "--view" plays a trial back from its logs.
+    string mode = argc >= 2 ? argv[1] : "";
+    bool serve = mode == "--serve" && argc <= 3;
+    bool optimise = mode == "--optimise" && argc == 2;
+    bool replay = mode == "--replay" && argc >= 3 && argc <= 5;
+    bool view = mode == "--view" && argc >= 4 && argc <= 5;
+    if (argc >= 2 && !serve && !optimise && !replay && !view) {
+        cerr << "Usage\n\tcwaggle_lasso\n\tcwaggle_lasso --serve [SOCKET_PATH]\n\tcwaggle_lasso --optimise"
+             << "\n\tcwaggle_lasso --replay REPLAY_FILE [FROM_STEP [TO_STEP]]"
+             << "\n\tcwaggle_lasso --view DATA_DIR TRIAL [FROM_STEP]" << endl;
         return -1;
     }
 
+    if (replay) {
+        InstallStopHandlers();
+        return replayTrial(argv[2], argc >= 4 ? atol(argv[3]) : 0, argc >= 5 ? atol(argv[4]) : 0);
+    }
+
     // Read the config file name from console if it exists
     string configFile = "lasso_config.txt";
     Config config;
     config.load(configFile);
 
+    if (optimise)
+        return Optimiser(config).run();
+
+    // The world is built from lasso_config.txt, so it should be the one the trial ran with.
+    if (view) {
+        InstallStopHandlers();
+        ReplayViewer viewer(config, argv[2], atoi(argv[3]));
+        if (!viewer.load())
+            return 1;
+        return viewer.run(argc >= 5 ? atof(argv[4]) : 0);
+    }
+
+    // From here on SIGTERM and SIGINT stop the work gracefully; see Budget.hpp.
+    InstallStopHandlers();
+
+    if (serve) {
+        JobServer server(config);
+        if (argc == 3)
+            return server.serveSocket(argv[2]);
+        server.serveStream(cin, cout);
+        return 0;
+    }
+
+    RunBudget budget(config.sweepTimeBudget, config.sweepStepBudget);
     if (config.arenaSweep)
-        arenaSweep(config);
+        arenaSweep(config, budget);
     else
-        runParamOrSingle(config);
+        runParamOrSingle(config, budget);
 
+    if (StopRequested()) {
+        cerr << "Stopped by signal " << g_stopSignal << "." << endl;
+        return 128 + g_stopSignal;
+    }
     return 0;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 
 #include "Config.hpp"
 
+#include <algorithm>
+#include <map>
 #include <sstream>
 
 using namespace std;
@@ -159,37 +161,40 @@ void addFakeRobots(shared_ptr<World> world, Config config)
     }
 }
 
+/**
+ * Decoding the arena images is the most expensive part of creating a world, so each decoded
+ * grid is kept for the lifetime of the process and copied into every world that uses it.
+ */
+const ValueGrid & GetCachedGrid(const string & filename, double oobv)
+{
+    static map<pair<string, double>, ValueGrid> cache;
+
+    auto key = make_pair(filename, oobv);
+    auto it = cache.find(key);
+    if (it == cache.end())
+        it = cache.emplace(key, ValueGrid(filename, oobv)).first;
+    return it->second;
+}
+
+// True if arenaConfig names one of the arenas in ../../images/, which GetWorld can build.
+bool IsKnownArena(const string & arenaConfig)
+{
+    static const vector<string> arenas{ "sim_stadium_no_wall", "sim_stadium_one_wall", "sim_stadium_one_wall_double",
+        "sim_stadium_two_walls", "sim_stadium_three_walls", "live_no_wall", "live_one_wall" };
+    return find(arenas.begin(), arenas.end(), arenaConfig) != arenas.end();
+}
+
 shared_ptr<World> GetWorld(default_random_engine rng, Config config)
 {
-    string grid0Filename, grid1Filename;
-    if (config.arenaConfig == "sim_stadium_no_wall") {
-        grid0Filename = "../../images/sim_stadium_no_wall/travel_time.png";
-        grid1Filename = "../../images/sim_stadium_no_wall/start_bar.png";
-    } else if (config.arenaConfig == "sim_stadium_one_wall") {
-        grid0Filename = "../../images/sim_stadium_one_wall/travel_time.png";
-        grid1Filename = "../../images/sim_stadium_one_wall/start_bar.png";
-    } else if (config.arenaConfig == "sim_stadium_one_wall_double") {
-        grid0Filename = "../../images/sim_stadium_one_wall_double/travel_time.png";
-        grid1Filename = "../../images/sim_stadium_one_wall_double/start_bar.png";
-    } else if (config.arenaConfig == "sim_stadium_two_walls") {
-        grid0Filename = "../../images/sim_stadium_two_walls/travel_time.png";
-        grid1Filename = "../../images/sim_stadium_two_walls/start_bar.png";
-    } else if (config.arenaConfig == "sim_stadium_three_walls") {
-        grid0Filename = "../../images/sim_stadium_three_walls/travel_time.png";
-        grid1Filename = "../../images/sim_stadium_three_walls/start_bar.png";
-    } else if (config.arenaConfig == "live_no_wall") {
-        grid0Filename = "../../images/live_no_wall/travel_time.png";
-        grid1Filename = "../../images/live_no_wall/start_bar.png";
-    } else if (config.arenaConfig == "live_one_wall") {
-        grid0Filename = "../../images/live_one_wall/travel_time.png";
-        grid1Filename = "../../images/live_one_wall/start_bar.png";
-    } else {
+    if (!IsKnownArena(config.arenaConfig)) {
         cerr << "worlds.hpp: Unknown setting for arenaConfig: " << config.arenaConfig << endl;
         exit(1);
     }
+    string grid0Filename = "../../images/" + config.arenaConfig + "/travel_time.png";
+    string grid1Filename = "../../images/" + config.arenaConfig + "/start_bar.png";
 
-    ValueGrid valueGrid0(grid0Filename, 1.0);
-    ValueGrid valueGrid1(grid1Filename, 0.0);
+    ValueGrid valueGrid0 = GetCachedGrid(grid0Filename, 1.0);
+    ValueGrid valueGrid1 = GetCachedGrid(grid1Filename, 0.0);
 
     size_t width = valueGrid0.width();
     size_t height = valueGrid0.height();
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../lasso/TrajectoryCodec.hpp"
+#include "../lasso/SweepArchive.hpp"
+
+using namespace std;
+
+/**
+ * Command-line tool for the compressed logs written by cwaggle_lasso.  It is built without
+ * SFML so that it can run wherever the data is copied to.
+ *
+ *   cwaggle_logtool info FILE.trj
+ *   cwaggle_logtool decode FILE.trj [FROM_STEP [TO_STEP]]
+ *   cwaggle_logtool list ARCHIVE
+ *   cwaggle_logtool extract ARCHIVE CONDITION TRIAL STREAM
+ *   cwaggle_logtool reindex ARCHIVE
+ *
+ * "decode" writes the frames as text lines, "step value value ...", in the layout of the
+ * uncompressed robotPose_/puckPosition_ .dat files, so the analysis scripts can read them.
+ * "list" and "extract" read a SweepArchive, where e.g. CONDITION is "../../data/no_wall"
+ * and STREAM is "stats.dat"; "reindex" rebuilds the archive's index from the archive.
+ */
+int decode(const string & filename, int64_t fromStep, int64_t toStep)
+{
+    TrajectoryDecoder decoder(filename);
+    if (!decoder.good()) {
+        cerr << "Not a trajectory file: " << filename << endl;
+        return -1;
+    }
+
+    // Print each value with as many decimals as its quantum resolves.
+    vector<int> decimals;
+    for (double q : decoder.getQuanta())
+        decimals.push_back(q >= 1 ? 0 : (int)ceil(-log10(q) - 1e-9));
+
+    decoder.seek(fromStep);
+    int64_t step;
+    vector<double> values;
+    cout << fixed;
+    while (decoder.next(step, values)) {
+        if (step < fromStep)
+            continue;
+        if (step > toStep)
+            break;
+        cout << step;
+        for (size_t i = 0; i < values.size(); i++)
+            cout << " " << setprecision(decimals[i]) << values[i];
+        cout << "\n";
+    }
+    return 0;
+}
+
+int info(const string & filename)
+{
+    TrajectoryDecoder decoder(filename);
+    if (!decoder.good()) {
+        cerr << "Not a trajectory file: " << filename << endl;
+        return -1;
+    }
+
+    size_t frames = 0;
+    int64_t step, firstStep = 0, lastStep = 0;
+    vector<double> values;
+    while (decoder.next(step, values)) {
+        if (frames++ == 0)
+            firstStep = step;
+        lastStep = step;
+    }
+    cout << filename << ": " << decoder.numValues() << " values per frame, " << frames
+         << " frames, steps " << firstStep << " to " << lastStep << endl;
+    return 0;
+}
+
+// A line per stream, with its length summed over its segments.
+int list(const string & archive)
+{
+    vector<SweepArchive::Entry> entries = SweepArchive::readIndex(archive);
+    for (auto & e : entries) {
+        if (e.stream.find('#') != string::npos)
+            continue;
+        uint64_t length = 0;
+        for (auto & segment : SweepArchive::findSegments(entries, e.condition, e.trial, e.stream))
+            length += segment.length;
+        cout << e.condition << "\t" << e.trial << "\t" << e.stream << "\t" << length << "\n";
+    }
+    return 0;
+}
+
+int extract(const string & archive, const string & condition, int trial, const string & stream)
+{
+    string data;
+    if (!SweepArchive::readStream(archive, SweepArchive::readIndex(archive), condition, trial, stream, data)) {
+        cerr << "No entry for " << condition << " " << trial << " " << stream << " in " << archive << endl;
+        return -1;
+    }
+    cout.write(data.data(), data.size());
+    return 0;
+}
+
+int reindex(const string & archive)
+{
+    vector<SweepArchive::Entry> entries = SweepArchive::scan(archive);
+    ofstream fout(archive + ".idx");
+    for (auto & e : entries)
+        fout << e.offset << " " << e.length << " " << e.trial << " " << e.stream << " " << e.condition << "\n";
+    cerr << entries.size() << " entries indexed" << endl;
+    return fout ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    string command = argc >= 3 ? argv[1] : "";
+    if (command == "info" && argc == 3)
+        return info(argv[2]);
+    if (command == "decode" && argc >= 3 && argc <= 5) {
+        int64_t fromStep = argc >= 4 ? atoll(argv[3]) : INT64_MIN;
+        int64_t toStep = argc >= 5 ? atoll(argv[4]) : INT64_MAX;
+        return decode(argv[2], fromStep, toStep);
+    }
+    if (command == "list" && argc == 3)
+        return list(argv[2]);
+    if (command == "extract" && argc == 6)
+        return extract(argv[2], argv[3], atoi(argv[4]), argv[5]);
+    if (command == "reindex" && argc == 3)
+        return reindex(argv[2]);
+
+    cerr << "Usage\n\tcwaggle_logtool info FILE.trj\n\tcwaggle_logtool decode FILE.trj [FROM_STEP [TO_STEP]]"
+         << "\n\tcwaggle_logtool list ARCHIVE\n\tcwaggle_logtool extract ARCHIVE CONDITION TRIAL STREAM"
+         << "\n\tcwaggle_logtool reindex ARCHIVE" << endl;
+    return -1;
+}